@@ -0,0 +1,1147 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "clock.h"
+#include "ad5933.h"
+#include "filter.h"
+#include "event.h"
+#include "delta.h"
+#include "stats.h"
+#include "zoom.h"
+#include "scan.h"
+#include "temp.h"
+#include "ref.h"
+#include "power.h"
+#include "plan.h"
+#include "usart0.h"
+#include "workspace.h"
+#include "acquire.h"
+
+/*  The conversion process takes approximately 1 ms using a 16.777 MHz
+ *  clock, so there is no point in polling the status register before. */
+#define CONVERSION_TICKS (CLOCK_HZ / 1000)
+
+/*  A temperature measurement takes 800 us */
+#define TEMPERATURE_TICKS (CLOCK_HZ / 1000)
+
+/*  Longest parts of a freerun line, "<seq> <tick> <tag> <R> <I>\n", and of
+ *  the loss marker */
+#define LINE_PACE_MAX 22
+#define LINE_TAG_MAX  4
+#define LINE_RI_MAX   14
+#define LINE_LOST_MAX 13
+
+/*  Sweeps and single-device freeruns use the first front-end */
+static AD5933 *const ad = ad5933_devices;
+
+static struct {
+    FILE *stream;
+    uint8_t mode;
+    bool waiting;       // waiting for the next sweep to be started
+    bool armed;         // waiting for the next paced freerun slot
+    bool delta;
+    bool stats;
+    bool zoom;
+    bool scan;
+    bool trigger_wait;  // armed and waiting for the external trigger
+    uint8_t average;
+    uint8_t n;          // samples accumulated for the current point
+    uint16_t point;
+    uint16_t npoints;
+    uint16_t samples;   // freerun samples of the current run
+    uint16_t limit;     // freerun samples per run, 0 = until aborted
+    uint16_t sweep;     // sweeps started
+    uint16_t count;
+    uint32_t interval;
+    uint32_t next;      // tick on which the next sweep is due
+    int32_t real;
+    int32_t imag;
+    uint32_t t;         // tick when the current conversion was started
+    const SweepOptions *opts;
+    bool drop;
+    uint16_t lost;      // freerun samples dropped since the last one sent
+    uint32_t lost_total;
+    bool restart;       // freerun has to be restarted after a measurement
+} acq;
+
+/*  Sweep start statistics of a repeated run */
+static struct {
+    uint32_t last;
+    uint32_t sum;
+    uint32_t min;
+    uint32_t max;
+    uint16_t late;      // sweeps that could not be started on time
+    uint32_t busy;      // ticks from start to completion of the sweeps
+    uint32_t length;    // ticks the last completed sweep took
+    uint16_t done;      // completed sweeps
+} period;
+
+/*  Frequency hopping state of a round-robin freerun */
+static struct {
+    uint8_t n;
+    uint8_t i;          // index of the frequency being measured
+    uint32_t code[ACQ_MAX_FREQS];
+    uint32_t samples[ACQ_MAX_FREQS];
+    uint32_t t0;
+    uint32_t fstart;    // restored when the run ends
+    uint16_t tsettle;
+    uint8_t xtsettle;
+} hop;
+
+/*  Interleaved freerun on several AD5933. Each part is restarted as soon
+ *  as it has been read, so the others keep converting while its sample is
+ *  printed and the bus is free for them. */
+static struct {
+    uint8_t n;
+    uint8_t i;          // device polled next
+    uint32_t t[BOARD_NDEVICES]; // tick when the conversion was started
+    uint32_t samples[BOARD_NDEVICES];
+    uint32_t t0;
+} multi;
+
+/*  Timer paced freerun */
+static struct {
+    uint16_t rate;
+    volatile uint8_t due; // slots elapsed since the last conversion start
+    uint32_t seq;       // slot of the current conversion
+    uint32_t dropped;
+    uint32_t t;         // tick when the current conversion was started
+} pace;
+
+/*  Adaptive zoom sweep */
+static struct {
+    uint8_t feature;
+    uint8_t nregions;
+    uint8_t n;          // features found in the coarse pass
+    uint8_t stage;      // 0 = coarse pass, i = dense sub-sweep of feature i
+    uint16_t center[ZOOM_MAX_REGIONS];
+    uint16_t ncoarse;
+    uint16_t ndense;    // dense sub-sweep increments
+    uint16_t next;      // first coarse point not printed yet
+    uint32_t fstart;    // coarse pass, restored when the run ends
+    uint32_t fincr;
+    uint32_t start;     // current dense sub-sweep
+    uint32_t incr;
+    double fc[ZOOM_MAX_REGIONS]; // feature frequencies in Hz
+    uint32_t t0;
+} zoom;
+
+/*  Electrode multiplexer scan */
+static struct {
+    uint8_t n;
+    uint8_t i;          // position in order
+    uint8_t order[SCAN_MAX_CHANNELS];
+    bool reverse;       // the pass runs through order backwards
+    uint16_t pass;
+    uint16_t reconfig;  // AD5933 reconfigurations
+    uint32_t fcode;     // programmed into the AD5933
+    uint16_t nincr;
+    uint32_t fstart;    // options, restored when the run ends
+    uint16_t sweep;
+    uint32_t t0;        // tick on which the current pass was started
+} scan;
+
+/*  External trigger */
+static struct {
+    uint8_t edge;       // 0 = not triggered
+    uint16_t count;     // triggered runs, 0 = until aborted
+    uint16_t n;         // triggers seen
+    volatile bool fired;
+    uint32_t t;         // tick of the last trigger
+    uint16_t latency;   // trigger to conversion start, in clock_fine() counts
+    uint16_t min;
+    uint16_t max;
+} trig;
+
+/*  Scheduled temperature readings */
+static struct {
+    uint16_t every;     // sweeps between readings, 0 = none
+    uint16_t due;       // sweep before which the next reading is taken
+    uint32_t interval;  // ticks between freerun readings
+    uint32_t last;      // tick of the last freerun reading
+    bool busy;          // measurement running
+    bool drift;         // correct results for the temperature drift
+    uint32_t t;         // tick when the measurement was started
+} temp;
+
+/*  Reference load measurement stages */
+#define REF_IDLE    0
+#define REF_SWITCH  1   // switched to the reference load, settling
+#define REF_MEASURE 2
+#define REF_RETURN  3   // switched back to the electrodes, settling
+
+/*  Interleaved reference load measurements */
+static struct {
+    uint16_t every;     // sweeps between measurements, 0 = none
+    uint16_t due;       // sweep before which the next measurement is taken
+    uint32_t interval;  // ticks between freerun measurements
+    uint32_t last;      // tick of the last freerun measurement
+    uint8_t n;          // reference points, 0 = no correction
+    uint8_t stage;
+    uint8_t j;          // reference point being measured
+    uint8_t k;          // samples of the point so far
+    int32_t real;
+    int32_t imag;
+    uint32_t t0;        // tick when the measurement was started
+    uint32_t t;         // tick when the stage or conversion was started
+    uint32_t fstart;    // frequency codes of the sweep
+    uint32_t fincr;
+} reference;
+
+static uint32_t first_sample_ticks;
+
+Workspace workspace;
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (pace.due < UINT8_MAX)
+        pace.due++;
+}
+
+/*  The AD5933 has been armed, so the conversion is started right here
+ *  with a polled write, whatever the main loop is printing. Nothing else
+ *  uses the bus while the trigger is enabled. */
+ISR(INT0_vect)
+{
+    uint32_t t = clock_fine(), d;
+
+    stop_int0();
+    ad5933_start_sweep(ad);
+    d = clock_fine() - t;
+    trig.latency = d > UINT16_MAX ? UINT16_MAX : d;
+    trig.t = clock_ticks();
+    trig.fired = true;
+}
+
+static void next_point(void)
+{
+    acq.n = 0;
+    acq.real = 0;
+    acq.imag = 0;
+    acq.t = clock_ticks();
+}
+
+static bool repeated(void)
+{
+    return acq.mode == ACQ_SWEEP && acq.count != 1 && !trig.edge && !acq.scan;
+}
+
+/*  Average of n samples, rounded to the nearest integer */
+static int16_t average(int32_t sum, uint8_t n)
+{
+    return (sum >= 0 ? sum + n / 2 : sum - n / 2) / n;
+}
+
+static void begin_sweep(void)
+{
+    uint32_t now, dt;
+
+    ad5933_init_with_fstart(ad);
+    ad5933_start_sweep(ad);
+    now = clock_ticks();
+
+    if (acq.sweep > 0) {
+        dt = now - period.last;
+        period.sum += dt;
+        if (dt < period.min)
+            period.min = dt;
+        if (dt > period.max)
+            period.max = dt;
+    }
+    period.last = now;
+
+    /*  Keep the schedule on a fixed grid, unless we already missed the slot.
+     *  A sweep is late once it starts more than a sweep length after its
+     *  slot. Back-to-back sweeps have no slots to miss. */
+    acq.next += acq.interval;
+    if ((int32_t) (now - acq.next) >= 0) {
+        if (acq.interval && acq.sweep > 0 && now - acq.next > period.length)
+            period.late++;
+        acq.next = now + acq.interval;
+    }
+
+    acq.sweep++;
+    acq.point = 0;
+    acq.waiting = false;
+    if (acq.delta)
+        delta_begin(acq.stream, acq.sweep, now, acq.npoints);
+    else if (repeated() && !acq.stats)
+        fprintf_P(acq.stream, PSTR("# %u %lu\n"), acq.sweep, now);
+    next_point();
+}
+
+static uint8_t scan_channel(void)
+{
+    return scan.order[scan.reverse ? scan.n - 1 - scan.i : scan.i];
+}
+
+/*  Switch to the channel at the current position and reprogram the
+ *  AD5933 if it is measured differently from the previous one. Its sweep
+ *  is started once the switches have settled. Returns false if the
+ *  channel is no longer in the table. */
+static bool select_channel(void)
+{
+    const ScanChannel *c = scan_get(scan_channel());
+    uint32_t fcode, due;
+    uint16_t nincr;
+
+    if (!c)
+        return false;
+    fcode = c->fcode ? c->fcode : scan.fstart;
+    nincr = c->fcode ? 0 : scan.sweep;
+
+    if (fcode != scan.fcode || nincr != scan.nincr) {
+        if (fcode != scan.fcode)
+            ad5933_set_fstart(ad, fcode);
+        if (nincr != scan.nincr)
+            ad5933_set_nincr(ad, nincr);
+        scan.fcode = fcode;
+        scan.nincr = nincr;
+        scan.reconfig++;
+    }
+    PORTB = c->port;
+    acq.npoints = nincr + 1;
+    acq.next = clock_ticks() + c->settle * CLOCK_TICKS_PER_MS;
+    acq.waiting = true;
+
+    if (scan.i == 0) {
+        due = scan.t0 + acq.interval;
+        if (scan.pass > 0 && (int32_t) (due - acq.next) > 0)
+            acq.next = due;
+        scan.t0 = acq.next;
+        if (acq.count != 1)
+            fprintf_P(acq.stream, PSTR("# %u %lu\n"), scan.pass + 1, acq.next);
+    }
+    return true;
+}
+
+/*  Move on to the next channel. Consecutive passes run in opposite
+ *  directions, so that the channel measured last is measured first again
+ *  without reconfiguration. Returns false when all passes are done or
+ *  the channel has gone missing. */
+static bool next_channel(void)
+{
+    if (++scan.i == scan.n) {
+        scan.pass++;
+        if (acq.count && scan.pass == acq.count)
+            return false;
+        scan.i = 0;
+        scan.reverse = !scan.reverse;
+    }
+    return select_channel();
+}
+
+/*  Put the AD5933 into standby with the start frequency applied, so that
+ *  the trigger only has to start the sweep, and enable the trigger */
+static void arm(void)
+{
+    ad5933_standby(ad);
+    ad5933_init_with_fstart(ad);
+    trig.fired = false;
+    acq.trigger_wait = true;
+    init_int0(trig.edge);
+}
+
+/*  Arm for the next trigger, unless all triggered runs are done */
+static bool rearm(void)
+{
+    if (!trig.edge || (trig.count && trig.n == trig.count))
+        return false;
+    arm();
+    return true;
+}
+
+/*  Start a run on a trigger. The ISR has already started the conversion. */
+static void triggered(void)
+{
+    trig.n++;
+    if (trig.latency < trig.min)
+        trig.min = trig.latency;
+    if (trig.latency > trig.max)
+        trig.max = trig.latency;
+    fprintf_P(acq.stream, PSTR("# trigger %u %lu %lu us\n"), trig.n, trig.t,
+        trig.latency * 1000UL / (CLOCK_FINE_HZ / 1000));
+
+    acq.trigger_wait = false;
+    acq.sweep++;
+    acq.point = 0;
+    acq.samples = 0;
+    next_point();
+}
+
+/*  Reprogram the start frequency from the precomputed code and restart */
+static void next_frequency(void)
+{
+    if (++hop.i == hop.n)
+        hop.i = 0;
+    ad5933_set_fstart(ad, hop.code[hop.i]);
+    ad5933_init_with_fstart(ad);
+    ad5933_start_sweep(ad);
+}
+
+/*  Start the next freerun conversion. Temperature and reference
+ *  measurements leave the AD5933 in another function or frequency, so it
+ *  is started over after one. */
+static void start_conversion(void)
+{
+    if (hop.n > 1) {
+        next_frequency();
+    } else if (acq.restart) {
+        ad5933_init_with_fstart(ad);
+        ad5933_start_sweep(ad);
+    } else {
+        ad5933_repeat_frequency(ad);
+    }
+    acq.restart = false;
+}
+
+static void measure_temperature(void)
+{
+    ad5933_meas_temperature(ad);
+    temp.busy = true;
+    temp.t = clock_ticks();
+}
+
+/*  Print the temperature once it has been measured and update the drift
+ *  correction. Returns false while the measurement is still running. */
+static bool read_temperature(void)
+{
+    int16_t t;
+
+    if (clock_ticks() - temp.t < TEMPERATURE_TICKS)
+        return false;
+    if (!ad5933_has_valid_temperature(ad))
+        return false;
+
+    t = temp_centi(ad5933_get_temperature(ad));
+    temp.busy = false;
+    fprintf_P(acq.stream, PSTR("# temp %lu %S%d.%02d"), temp.t,
+        t < 0 ? PSTR("-") : PSTR(""), abs(t) / 100, abs(t) % 100);
+    if (temp.drift)
+        fprintf_P(acq.stream, PSTR(" %ld ppm"), temp_drift_update(t));
+    fprintf_P(acq.stream, PSTR("\n"));
+    return true;
+}
+
+/*  Characters the next freerun line may take */
+static uint8_t line_max(void)
+{
+    uint8_t n = LINE_RI_MAX;
+
+    if (pace.rate)
+        n += LINE_PACE_MAX;
+    if (hop.n || multi.n)
+        n += LINE_TAG_MAX;
+    if (acq.lost)
+        n += LINE_LOST_MAX;
+    return n;
+}
+
+/*  Switch to the reference load and let it settle */
+static void begin_reference(void)
+{
+    PORTB = BOARD_REF_PORT;
+    reference.stage = REF_SWITCH;
+    reference.j = 0;
+    reference.t0 = clock_ticks();
+    reference.t = reference.t0;
+}
+
+/*  Start averaging the current reference point. A freerun has only one,
+ *  at the frequency already programmed. */
+static void start_reference_point(void)
+{
+    if (acq.mode == ACQ_SWEEP)
+        ad5933_set_fstart(ad, reference.fstart + ref_point(reference.j) * reference.fincr);
+    ad5933_init_with_fstart(ad);
+    ad5933_start_sweep(ad);
+    reference.k = 0;
+    reference.real = 0;
+    reference.imag = 0;
+    reference.t = clock_ticks();
+}
+
+/*  Advance the reference measurement and print the corrections once all
+ *  points have been read. Returns true when the electrodes are connected
+ *  again and have settled. */
+static bool reference_task(void)
+{
+    double phase;
+    int32_t ppm;
+    uint8_t j;
+
+    if (reference.stage != REF_MEASURE) {
+        if (clock_ticks() - reference.t < BOARD_REF_SETTLE_MS * CLOCK_TICKS_PER_MS)
+            return false;
+        if (reference.stage == REF_RETURN) {
+            reference.stage = REF_IDLE;
+            return true;
+        }
+        reference.stage = REF_MEASURE;
+        start_reference_point();
+        return false;
+    }
+
+    if (clock_ticks() - reference.t < CONVERSION_TICKS)
+        return false;
+    if (!ad5933_has_valid_impedance(ad))
+        return false;
+    reference.real += ad5933_get_real(ad);
+    reference.imag += ad5933_get_imaginary(ad);
+    if (++reference.k < REF_AVERAGE) {
+        ad5933_repeat_frequency(ad);
+        reference.t = clock_ticks();
+        return false;
+    }
+    ref_update(reference.j, reference.real, reference.imag);
+    if (++reference.j < reference.n) {
+        start_reference_point();
+        return false;
+    }
+
+    PORTB = 0;
+    if (acq.mode == ACQ_SWEEP)
+        ad5933_set_fstart(ad, reference.fstart);
+    reference.stage = REF_RETURN;
+    reference.t = clock_ticks();
+
+    fprintf_P(acq.stream, PSTR("# ref %lu"), reference.t0);
+    for (j = 0; j < reference.n; j++) {
+        ppm = ref_gain(j, &phase);
+        fprintf_P(acq.stream, PSTR(" %ld %.3f"), ppm, phase);
+    }
+    fprintf_P(acq.stream, PSTR("\n"));
+    return false;
+}
+
+/*  Filter a freerun sample of the frequency or device tag and print it if
+ *  the filter produced an output */
+static void put_freerun(uint8_t tag, int real, int imag)
+{
+    uint8_t ch = 2 * tag;
+    int16_t r = real, i = imag;
+
+    if (filter_enabled()) {
+        filter_put(ch + 1, imag, &i);
+        if (!filter_put(ch, real, &r))
+            return;
+    }
+    if (event_enabled()) {
+        event_heartbeat(acq.stream);
+        if (!event_put(ch / 2, r, i))
+            return;
+    }
+
+    /*  Rather than stall the run, drop the sample if the host is behind */
+    if (acq.drop && usart0_tx_free() < line_max()) {
+        if (acq.lost < UINT16_MAX)
+            acq.lost++;
+        acq.lost_total++;
+        return;
+    }
+    if (acq.lost) {
+        fprintf_P(acq.stream, PSTR("# lost %u\n"), acq.lost);
+        acq.lost = 0;
+    }
+
+    if (pace.rate)
+        fprintf_P(acq.stream, PSTR("%lu %lu "), pace.seq, pace.t);
+    if (hop.n || multi.n)
+        fprintf_P(acq.stream, PSTR("%hhu "), tag);
+    fprintf_P(acq.stream, PSTR("%d %d\n"), r, i);
+}
+
+/*  Print the coarse points below the next feature and start its dense
+ *  sub-sweep. Returns false when all features have been swept. */
+static bool next_zoom(void)
+{
+    uint16_t c, first, last;
+
+    if (zoom.stage == 0)
+        zoom.n = zoom_find(zoom.feature, zoom.ncoarse, zoom.fstart, zoom.fincr,
+            zoom.nregions, zoom.center);
+    else
+        zoom.fc[zoom.stage - 1] = ad5933_freq_hz(zoom.start)
+            + zoom_refine(zoom.feature, zoom.ndense + 1, zoom.start, zoom.incr)
+            * ad5933_freq_hz(zoom.incr);
+    if (zoom.stage == zoom.n)
+        return false;
+
+    c = zoom.center[zoom.stage++];
+    first = c > 0 ? c - 1 : c;
+    last = c + 1 < zoom.ncoarse ? c + 1 : c;
+    zoom_print(acq.stream, zoom.next, first, zoom.fstart, zoom.fincr);
+    zoom.next = last + 1;
+
+    zoom.start = zoom.fstart + first * zoom.fincr;
+    /*  Rounded up, so that the last point reaches last */
+    zoom.incr = ((last - first) * zoom.fincr + zoom.ndense - 1) / zoom.ndense;
+    ad5933_set_fstart(ad, zoom.start);
+    ad5933_set_fincr(ad, zoom.incr);
+    ad5933_set_nincr(ad, zoom.ndense);
+    acq.npoints = zoom.ndense + 1;
+    begin_sweep();
+    return true;
+}
+
+static void finish_zoom(void)
+{
+    uint32_t dt = clock_ticks() - zoom.t0;
+    uint8_t i;
+
+    zoom_print(acq.stream, zoom.next, zoom.ncoarse, zoom.fstart, zoom.fincr);
+    for (i = 0; i < zoom.n; i++)
+        fprintf_P(acq.stream, PSTR("# fc %.2f\n"), zoom.fc[i]);
+    fprintf_P(acq.stream, PSTR("# zoom %u points, %lu.%lu ms\n"),
+        zoom.ncoarse + zoom.n * (zoom.ndense + 1),
+        dt / CLOCK_TICKS_PER_MS, dt % CLOCK_TICKS_PER_MS);
+}
+
+static void print_rates(const uint32_t *samples, uint8_t n, uint32_t t0)
+{
+    uint32_t dt = clock_ticks() - t0, rate;
+    uint8_t i;
+
+    for (i = 0; i < n; i++) {
+        /*  Sample rate in tenths of Hz */
+        rate = dt ? (uint64_t) samples[i] * CLOCK_HZ * 10 / dt : 0;
+        fprintf_P(acq.stream, PSTR("# %hhu %lu samples, %lu.%lu Hz\n"), i,
+            samples[i], rate / 10, rate % 10);
+    }
+}
+
+/*  Poll the next device of an interleaved freerun */
+static void multi_task(void)
+{
+    uint8_t i = multi.i;
+    AD5933 *dev = &ad5933_devices[i];
+    int real, imag;
+
+    if (++multi.i == multi.n)
+        multi.i = 0;
+    if (clock_ticks() - multi.t[i] < CONVERSION_TICKS)
+        return;
+    if (!ad5933_has_valid_impedance(dev))
+        return;
+
+    if (first_sample_ticks == 0)
+        first_sample_ticks = clock_ticks();
+    real = ad5933_get_real(dev);
+    imag = ad5933_get_imaginary(dev);
+    ad5933_repeat_frequency(dev);
+    multi.t[i] = clock_ticks();
+    multi.samples[i]++;
+    put_freerun(i, real, imag);
+}
+
+/*  Point average in 1/256 without overflowing 32 bits */
+static int32_t average_q8(int32_t sum, uint8_t n)
+{
+    return sum / n * 256 + sum % n * 256 / n;
+}
+
+/*  The measured sweep time is compared with the prediction of plan.h */
+static void print_summary(void)
+{
+    PlanTimes plan;
+    uint32_t mean;
+
+    fprintf_P(acq.stream, PSTR("# %u sweeps"), acq.sweep);
+    if (acq.sweep > 1) {
+        mean = period.sum / (acq.sweep - 1);
+        fprintf_P(acq.stream, PSTR(", period %lu.%lu ms, jitter %lu.%lu ms, %u late"),
+            mean / CLOCK_TICKS_PER_MS, mean % CLOCK_TICKS_PER_MS,
+            (period.max - period.min) / CLOCK_TICKS_PER_MS,
+            (period.max - period.min) % CLOCK_TICKS_PER_MS, period.late);
+    }
+    if (period.done) {
+        mean = period.busy / period.done;
+        plan_sweep(acq.opts, acq.delta ? PLAN_DELTA : acq.stats ? PLAN_STATS : PLAN_TEXT,
+            &plan);
+        fprintf_P(acq.stream, PSTR(", sweep %lu.%lu ms, %.1f ms predicted"),
+            mean / CLOCK_TICKS_PER_MS, mean % CLOCK_TICKS_PER_MS, plan.total);
+    }
+    fprintf_P(acq.stream, PSTR("\n"));
+}
+
+void acq_start(FILE *stream, const AcqParams *p, const SweepOptions *o)
+{
+    uint8_t i;
+
+    power_begin_run();
+    acq.stream = stream;
+    acq.mode = p->mode;
+    acq.opts = o;
+    acq.average = (p->mode == ACQ_SWEEP) ? o->average : p->average ? p->average : 1;
+    acq.npoints = (p->mode == ACQ_SWEEP) ? o->nincr + 1 : 0;
+    acq.count = p->count;
+    acq.limit = (p->mode == ACQ_FREERUN) ? p->samples : 0;
+    acq.samples = 0;
+    acq.interval = p->interval;
+    acq.sweep = 0;
+    acq.next = clock_ticks() - p->interval;
+
+    acq.delta = (p->mode == ACQ_SWEEP) && p->delta && acq.npoints <= DELTA_MAX_POINTS;
+    if (acq.delta)
+        delta_init(p->keyint);
+    acq.stats = (p->mode == ACQ_SWEEP) && p->stats && !acq.delta
+        && acq.npoints <= STATS_MAX_POINTS;
+    if (acq.stats) {
+        stats_reset();
+        if (acq.count == 0)
+            acq.count = STATS_MAX_SWEEPS;
+    }
+
+    acq.zoom = (p->mode == ACQ_SWEEP) && p->zoom && !acq.delta && !acq.stats
+        && acq.npoints <= ZOOM_MAX_POINTS;
+    if (acq.zoom) {
+        acq.count = 1;
+        zoom.feature = p->feature;
+        zoom.nregions = p->regions;
+        zoom.stage = 0;
+        zoom.ncoarse = acq.npoints;
+        zoom.ndense = p->zoom;
+        zoom.next = 0;
+        zoom.fstart = ad5933_freq_code(o->fstart);
+        zoom.fincr = ad5933_freq_code(o->fincr);
+        zoom.t0 = clock_ticks();
+    }
+
+    hop.n = (p->mode == ACQ_FREERUN) ? p->nfreqs : 0;
+    hop.i = 0;
+    if (hop.n) {
+        for (i = 0; i < hop.n; i++) {
+            hop.code[i] = p->fcode[i];
+            hop.samples[i] = 0;
+        }
+        hop.fstart = ad5933_freq_code(o->fstart);
+        hop.tsettle = o->tsettle;
+        hop.xtsettle = o->xtsettle;
+        ad5933_set_tsettle(ad, p->settle, 1);
+        ad5933_set_fstart(ad, hop.code[0]);
+        hop.t0 = clock_ticks();
+    }
+
+    acq.drop = (p->mode == ACQ_FREERUN) && p->drop;
+    acq.lost = 0;
+    acq.lost_total = 0;
+    if (p->mode == ACQ_FREERUN) {
+        filter_reset();
+        event_reset();
+    }
+    acq.armed = false;
+    acq.restart = false;
+    pace.rate = (p->mode == ACQ_FREERUN) ? p->rate : 0;
+    pace.seq = 0;
+    pace.dropped = 0;
+    pace.due = 0;
+    if (pace.rate && init_timer1(pace.rate) == -1)
+        pace.rate = 0;
+
+    period.sum = 0;
+    period.min = UINT32_MAX;
+    period.max = 0;
+    period.late = 0;
+    period.busy = 0;
+    period.length = 0;
+    period.done = 0;
+
+    temp.every = (p->mode == ACQ_SWEEP) ? p->temp : 0;
+    temp.due = 0;
+    temp.interval = (p->mode == ACQ_FREERUN) ? p->temp * CLOCK_HZ : 0;
+    temp.last = clock_ticks() - temp.interval;
+    temp.busy = false;
+    temp.drift = p->temp && p->drift;
+    temp_drift_init(temp.drift ? p->drift : 0, p->tref);
+
+    /*  Not in a scan, which drives PORTB itself, nor with zoom or hopping */
+    reference.every = (p->mode == ACQ_SWEEP && !p->scan && !acq.zoom) ? p->ref : 0;
+    reference.due = 0;
+    reference.interval = (p->mode == ACQ_FREERUN && !hop.n) ? p->ref * CLOCK_HZ : 0;
+    reference.last = clock_ticks() - reference.interval;
+    reference.stage = REF_IDLE;
+    reference.n = 0;
+    if (reference.every || reference.interval) {
+        reference.n = ref_init(p->mode == ACQ_SWEEP ? acq.npoints : 1);
+        reference.fstart = ad5933_freq_code(o->fstart);
+        reference.fincr = ad5933_freq_code(o->fincr);
+    }
+
+    acq.scan = (p->mode == ACQ_SWEEP) && p->scan && !acq.delta && !acq.stats
+        && !acq.zoom;
+    if (acq.scan) {
+        scan.n = scan_order(scan.order);
+        scan.i = 0;
+        scan.reverse = false;
+        scan.pass = 0;
+        scan.reconfig = 0;
+        scan.fstart = ad5933_freq_code(o->fstart);
+        scan.sweep = o->nincr;
+        scan.fcode = scan.fstart;
+        scan.nincr = scan.sweep;
+        if (scan.n == 0 || !select_channel())
+            acq.mode = ACQ_IDLE;
+        return;
+    }
+
+    multi.n = (p->mode == ACQ_FREERUN && !hop.n && !pace.rate && !p->trigger)
+        ? p->devices : 0;
+    if (multi.n > BOARD_NDEVICES)
+        multi.n = BOARD_NDEVICES;
+    if (multi.n > ACQ_MAX_DEVICES)
+        multi.n = ACQ_MAX_DEVICES;
+    if (multi.n == 1)
+        multi.n = 0;
+    if (multi.n) {
+        temp.interval = 0;
+        temp.drift = false;
+        reference.interval = 0;
+        reference.n = 0;
+        multi.i = 0;
+        for (i = 0; i < multi.n; i++) {
+            ad5933_init_with_fstart(&ad5933_devices[i]);
+            ad5933_start_sweep(&ad5933_devices[i]);
+            multi.t[i] = clock_ticks();
+            multi.samples[i] = 0;
+        }
+        multi.t0 = clock_ticks();
+        return;
+    }
+
+    trig.edge = p->trigger;
+    if (trig.edge) {
+        temp.every = 0;
+        temp.interval = 0;
+        temp.drift = false;
+        reference.every = 0;
+        reference.interval = 0;
+        reference.n = 0;
+        trig.count = p->count;
+        trig.n = 0;
+        trig.min = UINT16_MAX;
+        trig.max = 0;
+        arm();
+        return;
+    }
+
+    /*  The first readings are taken before the first sweep */
+    if (temp.every || reference.every) {
+        acq.waiting = true;
+        return;
+    }
+    begin_sweep();
+    pace.t = acq.t;
+}
+
+void acq_abort(void)
+{
+    uint8_t i;
+
+    if (acq.mode == ACQ_IDLE)
+        return;
+    stop_int0();
+    if (acq.delta && !acq.waiting && acq.point < acq.npoints)
+        delta_abort(acq.stream, acq.point, acq.npoints);
+    if (acq.stats)
+        stats_print(acq.stream, acq.npoints, acq.sweep,
+            acq.waiting ? acq.npoints : acq.point);
+    if (repeated())
+        print_summary();
+    acq.mode = ACQ_IDLE;
+    temp.busy = false;
+    ad5933_reset(ad);
+
+    if (reference.stage != REF_IDLE) {
+        PORTB = 0;
+        if (reference.every)
+            ad5933_set_fstart(ad, reference.fstart);
+        reference.stage = REF_IDLE;
+    }
+    reference.n = 0;
+
+    if (acq.scan) {
+        PORTB = 0;
+        ad5933_set_fstart(ad, scan.fstart);
+        ad5933_set_nincr(ad, scan.sweep);
+        fprintf_P(acq.stream, PSTR("# %u passes, %u reconfigurations\n"), scan.pass,
+            scan.reconfig);
+        acq.scan = false;
+    }
+    if (acq.zoom) {
+        ad5933_set_fstart(ad, zoom.fstart);
+        ad5933_set_fincr(ad, zoom.fincr);
+        ad5933_set_nincr(ad, zoom.ncoarse - 1);
+        acq.zoom = false;
+    }
+
+    if (trig.edge) {
+        fprintf_P(acq.stream, PSTR("# %u triggers"), trig.n);
+        if (trig.n)
+            fprintf_P(acq.stream, PSTR(", latency %lu..%lu us"),
+                trig.min * 1000UL / (CLOCK_FINE_HZ / 1000),
+                trig.max * 1000UL / (CLOCK_FINE_HZ / 1000));
+        fprintf_P(acq.stream, PSTR("\n"));
+        trig.edge = 0;
+        acq.trigger_wait = false;
+    }
+    if (pace.rate) {
+        stop_timer1();
+        fprintf_P(acq.stream, PSTR("# %lu slots, %lu dropped\n"), pace.seq + 1,
+            pace.dropped);
+        pace.rate = 0;
+    }
+    if (acq.drop) {
+        fprintf_P(acq.stream, PSTR("# %lu samples lost\n"), acq.lost_total);
+        acq.drop = false;
+    }
+    if (multi.n) {
+        for (i = 1; i < multi.n; i++)
+            ad5933_reset(&ad5933_devices[i]);
+        print_rates(multi.samples, multi.n, multi.t0);
+        multi.n = 0;
+    }
+    if (hop.n) {
+        print_rates(hop.samples, hop.n, hop.t0);
+        ad5933_set_fstart(ad, hop.fstart);
+        ad5933_set_tsettle(ad, hop.tsettle, hop.xtsettle);
+        hop.n = 0;
+    }
+    power_end_run(acq.stream);
+}
+
+void acq_task(void)
+{
+    int real, imag;
+    uint8_t due;
+
+    if (acq.mode == ACQ_IDLE)
+        return;
+
+    if (acq.trigger_wait) {
+        if (trig.fired)
+            triggered();
+        return;
+    }
+
+    if (multi.n) {
+        multi_task();
+        return;
+    }
+
+    if (temp.busy) {
+        if (read_temperature() && acq.mode == ACQ_FREERUN && !acq.armed) {
+            start_conversion();
+            next_point();
+        }
+        return;
+    }
+
+    if (reference.stage != REF_IDLE) {
+        if (reference_task() && acq.mode == ACQ_FREERUN && !acq.armed) {
+            start_conversion();
+            next_point();
+        }
+        return;
+    }
+
+    if (acq.armed) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            due = pace.due;
+            pace.due = 0;
+        }
+        if (due == 0)
+            return;
+        pace.seq += due;
+        pace.dropped += due - 1;
+        acq.armed = false;
+        start_conversion();
+        next_point();
+        pace.t = acq.t;
+        return;
+    }
+
+    if (acq.waiting) {
+        if (temp.every && acq.sweep == temp.due) {
+            temp.due += temp.every;
+            measure_temperature();
+            return;
+        }
+        if (reference.every && acq.sweep == reference.due) {
+            reference.due += reference.every;
+            begin_reference();
+            return;
+        }
+        if ((int32_t) (clock_ticks() - acq.next) < 0)
+            return;
+        begin_sweep();
+        return;
+    }
+
+    if (clock_ticks() - acq.t < CONVERSION_TICKS)
+        return;
+    if (!ad5933_has_valid_impedance(ad))
+        return;
+
+    if (first_sample_ticks == 0)
+        first_sample_ticks = clock_ticks();
+
+    real = ad5933_get_real(ad);
+    imag = ad5933_get_imaginary(ad);
+    acq.real += real;
+    acq.imag += imag;
+
+    if (++acq.n < acq.average) {
+        ad5933_repeat_frequency(ad);
+        acq.t = clock_ticks();
+        return;
+    }
+    if (temp.drift) {
+        acq.real = temp_correct(acq.real);
+        acq.imag = temp_correct(acq.imag);
+    }
+    if (reference.n)
+        ref_correct(acq.mode == ACQ_SWEEP ? acq.point : 0, &acq.real, &acq.imag);
+
+    if (acq.mode == ACQ_FREERUN) {
+        if (hop.n)
+            hop.samples[hop.i]++;
+        put_freerun(hop.i, average(acq.real, acq.average), average(acq.imag, acq.average));
+        if (acq.limit && ++acq.samples == acq.limit) {
+            if (!rearm())
+                acq_abort();
+            return;
+        }
+        if (temp.interval && clock_ticks() - temp.last >= temp.interval) {
+            temp.last = clock_ticks();
+            acq.restart = true;
+            measure_temperature();
+            acq.armed = pace.rate != 0;
+            return;
+        }
+        if (reference.interval && clock_ticks() - reference.last >= reference.interval) {
+            reference.last = clock_ticks();
+            acq.restart = true;
+            begin_reference();
+            acq.armed = pace.rate != 0;
+            return;
+        }
+        if (pace.rate) {
+            acq.armed = true;
+            return;
+        }
+        start_conversion();
+    } else {
+        if (acq.delta)
+            delta_put(acq.stream, acq.point, average(acq.real, acq.average),
+                average(acq.imag, acq.average));
+        else if (acq.stats)
+            stats_put(acq.point, acq.sweep, average_q8(acq.real, acq.average),
+                average_q8(acq.imag, acq.average));
+        else if (acq.zoom && zoom.stage == 0)
+            zoom_put_coarse(acq.point, average(acq.real, acq.average),
+                average(acq.imag, acq.average));
+        else if (acq.zoom)
+            zoom_put_dense(acq.stream, acq.point, zoom.start + acq.point * zoom.incr,
+                average(acq.real, acq.average), average(acq.imag, acq.average));
+        else {
+            if (acq.scan)
+                fprintf_P(acq.stream, PSTR("%hhu "), scan_channel());
+            fprintf_P(acq.stream, PSTR("%.4f %.4f\n"),
+                (double) acq.real / acq.average, (double) acq.imag / acq.average);
+        }
+        acq.point++;
+        if (ad5933_sweep_complete(ad)) {
+            period.length = clock_ticks() - period.last;
+            period.busy += period.length;
+            period.done++;
+            if (acq.delta)
+                delta_end(acq.stream);
+            if (acq.zoom) {
+                if (!next_zoom()) {
+                    finish_zoom();
+                    acq_abort();
+                }
+                return;
+            }
+            if (acq.scan) {
+                if (!next_channel())
+                    acq_abort();
+                return;
+            }
+            if (trig.edge) {
+                if (!rearm())
+                    acq_abort();
+                return;
+            }
+            if (acq.count && acq.sweep == acq.count)
+                acq_abort();
+            else
+                acq.waiting = true;
+            return;
+        }
+        ad5933_increment_sweep(ad);
+    }
+    next_point();
+}
+
+bool acq_busy(void)
+{
+    return acq.mode != ACQ_IDLE;
+}
+
+uint8_t acq_mode(void)
+{
+    return acq.mode;
+}
+
+uint16_t acq_sweeps_done(void)
+{
+    return acq.sweep;
+}
+
+uint16_t acq_points_done(void)
+{
+    return acq.point;
+}
+
+uint16_t acq_points_total(void)
+{
+    return acq.npoints;
+}
+
+uint32_t acq_first_sample_ticks(void)
+{
+    return first_sample_ticks;
+}
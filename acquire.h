@@ -0,0 +1,113 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __ACQUIRE_H
+#define __ACQUIRE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "settings.h"
+#include "temp.h"
+
+/*  Acquisition modes */
+#define ACQ_IDLE    0
+#define ACQ_SWEEP   1
+#define ACQ_FREERUN 2
+
+/*  Maximum number of frequencies in a round-robin freerun */
+#define ACQ_MAX_FREQS 4
+
+/*  Maximum number of front-ends in an interleaved freerun, each using the
+ *  filter and event channels of one round-robin frequency */
+#define ACQ_MAX_DEVICES ACQ_MAX_FREQS
+
+typedef struct AcqParams AcqParams;
+
+struct AcqParams {
+    uint8_t mode;
+    uint16_t count;     // sweeps to run, 0 = until aborted
+    uint32_t interval;  // ticks between sweep starts, 0 = back-to-back
+    /*  Round-robin freerun: one sample per frequency in turn, prefixed with
+     *  the frequency index. The rate of each is reported at the end. */
+    uint8_t nfreqs;     // freerun frequencies, 0 = programmed start frequency
+    uint16_t settle;    // settling cycles after each frequency hop
+    uint32_t fcode[ACQ_MAX_FREQS]; // see ad5933_freq_code()
+    /*  Paced freerun: conversions start on Timer1 compare matches, samples
+     *  are prefixed with "<slot> <tick>", missed slots count as dropped. */
+    uint16_t rate;      // freerun samples per second, 0 = as fast as possible
+    bool delta;         // send sweeps delta encoded, see delta.h
+    uint16_t keyint;    // sweeps between delta keyframes
+    bool stats;         // accumulate per-point statistics, see stats.h
+    uint8_t zoom;       // dense sub-sweep increments, 0 = linear sweep
+    uint8_t regions;    // features to zoom into
+    uint8_t feature;    // ZOOM_REACTANCE or ZOOM_PHASE
+    uint16_t samples;   // freerun samples per run, 0 = until aborted
+    uint8_t average;    // freerun samples averaged per output, 0 = 1
+    /*  Triggered runs: the INT0 ISR starts the armed AD5933, and each of
+     *  count edges runs one sweep or samples samples, preceded by
+     *  "# trigger <n> <tick> <us>" with the latency of the start. */
+    uint8_t trigger;    // start on this INT0 edge (see board.h), 0 = now
+    bool scan;          // measure each channel of the scan table, see scan.h
+    /*  Interleaved freerun: samples prefixed with the device index, not
+     *  combined with nfreqs, rate or trigger. */
+    uint8_t devices;    // freerun on this many front-ends, see board.h
+    uint16_t temp;      // sweeps (freerun: seconds) between temperature readings
+    int16_t drift;      // gain drift to correct in ppm per C, see temp.h
+    int16_t tref;       // reference temperature in 1/100 C or TEMP_REF_FIRST
+    bool drop;          // drop freerun output that does not fit, see usart0.h
+    uint16_t ref;       // sweeps (freerun: s) between reference loads, see ref.h
+};
+
+/*  Start a sweep or freerun with the options already programmed into the
+ *  AD5933, o staying valid until the run ends. Results are written to
+ *  stream as they become available. Unless exactly one sweep is requested,
+ *  each sweep is preceded by "# <sweep> <tick>" and the run ends with a
+ *  summary of its period, jitter and sweep time against plan_sweep(). The
+ *  other fields of p enable the stages documented with them. */
+void acq_start(FILE *stream, const AcqParams *p, const SweepOptions *o);
+
+/*  Stop the running acquisition and reset the AD5933 */
+void acq_abort(void);
+
+/*  Advance the acquisition. Never waits for the AD5933, so it has to be
+ *  called repeatedly from the main loop. */
+void acq_task(void);
+
+bool acq_busy(void);
+uint8_t acq_mode(void);
+
+/*  Sweeps started so far */
+uint16_t acq_sweeps_done(void);
+
+/*  Points completed so far and points in total per sweep, zero for freerun */
+uint16_t acq_points_done(void);
+uint16_t acq_points_total(void);
+
+/*  Ticks from power-up to the first valid sample, 0 until then */
+uint32_t acq_first_sample_ticks(void);
+
+#endif
@@ -29,14 +29,32 @@
 #include "twi.h"
 #include "ad5933.h"
 
-typedef struct {
-    uint8_t msb;
-    uint8_t lsb;
-} ad5933_status_t;
+/*  Channels currently enabled on the multiplexer */
+static uint8_t mux_channels;
 
-ad5933_status_t ad5933_status = {0xA1, 0x00};
+/*  Route the bus to dev, unless it already is */
+static int select(AD5933 *dev)
+{
+    int rv = 0;
+
+    if (dev->mux == mux_channels)
+        return 0;
+    if (twi_start(TWI_SLA_MUX, TW_WRITE) == -1 || twi_write_byte(dev->mux) != 1)
+        rv = -1;
+    twi_stop();
+    if (rv == 0)
+        mux_channels = dev->mux;
+    return rv;
+}
 
-int ad5933_set_pointer(uint8_t paddr)
+static int start(AD5933 *dev, int rwbit)
+{
+    if (select(dev) == -1)
+        return -1;
+    return twi_start(dev->sla, rwbit);
+}
+
+int ad5933_set_pointer(AD5933 *dev, uint8_t paddr)
 {
     int rv = -1;
     uint8_t buf[2] = {
@@ -44,7 +62,7 @@ int ad5933_set_pointer(uint8_t paddr)
         paddr
     };
 
-    if (twi_start(TWI_SLA_AD5933, TW_WRITE) != -1)
+    if (start(dev, TW_WRITE) != -1)
         if (twi_write(buf, 2) == 2)
             rv = 0;
 
@@ -54,18 +72,18 @@ int ad5933_set_pointer(uint8_t paddr)
 
 /*  Read/Write a single byte
  * ------------------------------------------------------------------- */
-uint8_t ad5933_rbyte(uint8_t raddr)
+uint8_t ad5933_rbyte(AD5933 *dev, uint8_t raddr)
 {
     uint8_t b = 0;
 
-    if (ad5933_set_pointer(raddr) != -1)
-        if (twi_start(TWI_SLA_AD5933, TW_READ) != -1)
+    if (ad5933_set_pointer(dev, raddr) != -1)
+        if (start(dev, TW_READ) != -1)
             b = twi_read_byte();
 
     return b;
 }
 
-int ad5933_wbyte(uint8_t raddr, uint8_t b)
+int ad5933_wbyte(AD5933 *dev, uint8_t raddr, uint8_t b)
 {
     int rv = -1;
     uint8_t buf[2] = {
@@ -73,7 +91,7 @@ int ad5933_wbyte(uint8_t raddr, uint8_t b)
         b
     };
 
-    if (twi_start(TWI_SLA_AD5933, TW_WRITE) != -1)
+    if (start(dev, TW_WRITE) != -1)
         rv = twi_write(buf, 2);
 
     twi_stop();
@@ -82,7 +100,7 @@ int ad5933_wbyte(uint8_t raddr, uint8_t b)
 
 /*  Read/Write block
  * ------------------------------------------------------------------- */
-int ad5933_rblock(uint8_t raddr, uint8_t *buf, uint8_t n)
+int ad5933_rblock(AD5933 *dev, uint8_t raddr, uint8_t *buf, uint8_t n)
 {
     int rv = 0;
     uint8_t buffer[2] = {
@@ -91,18 +109,18 @@ int ad5933_rblock(uint8_t raddr, uint8_t *buf, uint8_t n)
     };
 
     /* Set start address for a block write */
-    if (ad5933_set_pointer(raddr) == -1)
+    if (ad5933_set_pointer(dev, raddr) == -1)
         goto error;
 
     /* Init block read */
-    if (twi_start(TWI_SLA_AD5933, TW_WRITE) == -1)
+    if (start(dev, TW_WRITE) == -1)
         goto error;
     if (twi_write(buffer, 2) != 2)
         goto error;
     // do not send stop here!
 
     /* Read block */
-    if (twi_start(TWI_SLA_AD5933, TW_READ) == -1)
+    if (start(dev, TW_READ) == -1)
         goto error;
     rv = twi_read(buf, n);
 
@@ -115,25 +133,24 @@ error:
     goto quit;
 }
 
-int ad5933_wblock(uint8_t raddr, uint8_t *buf, uint8_t n)
+int ad5933_wblock(AD5933 *dev, uint8_t raddr, uint8_t *buf, uint8_t n)
 {
-    uint8_t buffer[n+2], m;
     int rv = 0;
+    uint8_t buffer[2] = {
+        AD5933_CC_WBLOCK,
+        n
+    };
 
     /* Set start address for a block write */
-    if (ad5933_set_pointer(raddr) == -1)
+    if (ad5933_set_pointer(dev, raddr) == -1)
         goto error;
 
-    /* Init block write buffer */
-    buffer[0] = AD5933_CC_WBLOCK;
-    buffer[1] = n;
-    for (m = 0; m < n; m++)
-        buffer[m+2] = buf[m];
-
-    /* Write block */
-    if (twi_start(TWI_SLA_AD5933, TW_WRITE) == -1)
+    /* Write block command and data in the same transaction */
+    if (start(dev, TW_WRITE) == -1)
+        goto error;
+    if (twi_write(buffer, 2) != 2)
         goto error;
-    rv = twi_write(buffer, n+2) - 2;
+    rv = twi_write(buf, n);
 
 quit:
     twi_stop();
@@ -146,61 +163,69 @@ error:
 
 /*  Start frequency
  * ------------------------------------------------------------------- */
-int ad5933_set_fstart(uint32_t f)
+uint32_t ad5933_freq_code(double f)
+{
+    return (uint32_t) ((f * 536870912.0) / AD5933_CLOCK_HZ);
+}
+
+double ad5933_freq_hz(uint32_t code)
+{
+    return code * (AD5933_CLOCK_HZ / 536870912.0);
+}
+
+int ad5933_set_fstart(AD5933 *dev, uint32_t f)
 {
     uint8_t buf[3] = {
         (uint8_t) (f >> 16),
         (uint8_t) (f >> 8),
         (uint8_t) (f)
     };
-    if (ad5933_wblock(AD5933_FREQRH, buf, 3) != 3)
+    if (ad5933_wblock(dev, AD5933_FREQRH, buf, 3) != 3)
         return -1;
     return 0;
 }
 
-unsigned long int ad5933_get_fstart(void)
+unsigned long int ad5933_get_fstart(AD5933 *dev)
 {
     uint8_t buf[3];
-    if (ad5933_rblock(AD5933_FREQRH, buf, 3) == 3)
+    if (ad5933_rblock(dev, AD5933_FREQRH, buf, 3) == 3)
         return ((((unsigned long int) buf[0] << 8) | buf[1]) << 8) | buf[2];
     return 0;
 }
 
-int ad5933_set_fstart_hz(double f)
+int ad5933_set_fstart_hz(AD5933 *dev, double f)
 {
-    uint32_t code = (uint32_t) ((f * 536870912.0) / AD5933_CLOCK_HZ);
-    return ad5933_set_fstart(code);
+    return ad5933_set_fstart(dev, ad5933_freq_code(f));
 }
 
 /*  Frequency increment
  * ------------------------------------------------------------------- */
-int ad5933_set_fincr(uint32_t f)
+int ad5933_set_fincr(AD5933 *dev, uint32_t f)
 {
     uint8_t buf[3] = {
         (uint8_t) (f >> 16),
         (uint8_t) (f >> 8),
         (uint8_t) (f)
     };
-    return ad5933_wblock(AD5933_FINCRH, buf, 3);
+    return ad5933_wblock(dev, AD5933_FINCRH, buf, 3);
 }
 
-unsigned long int ad5933_get_fincr(void)
+unsigned long int ad5933_get_fincr(AD5933 *dev)
 {
     uint8_t buf[3];
-    if (ad5933_rblock(AD5933_FINCRH, buf, 3) == 3)
+    if (ad5933_rblock(dev, AD5933_FINCRH, buf, 3) == 3)
         return ((((unsigned long int) buf[0] << 8) | buf[1]) << 8) | buf[2];
     return 0;
 }
 
-int ad5933_set_fincr_hz(double f)
+int ad5933_set_fincr_hz(AD5933 *dev, double f)
 {
-    uint32_t code = (uint32_t) ((f * 536870912.0) / AD5933_CLOCK_HZ);
-    return ad5933_set_fincr(code);
+    return ad5933_set_fincr(dev, ad5933_freq_code(f));
 }
 
 /*  Number of frequency increments
  * ------------------------------------------------------------------- */
-int ad5933_set_nincr(uint16_t n)
+int ad5933_set_nincr(AD5933 *dev, uint16_t n)
 {
     if (n > 511)
         n = 511;
@@ -208,149 +233,149 @@ int ad5933_set_nincr(uint16_t n)
         (uint8_t) (n >> 8),
         (uint8_t) n
     };
-    return ad5933_wblock(AD5933_NINCRH, buf, 2);
+    return ad5933_wblock(dev, AD5933_NINCRH, buf, 2);
 }
 
-unsigned int ad5933_get_nincr(void)
+unsigned int ad5933_get_nincr(AD5933 *dev)
 {
     uint8_t buf[2];
-    if (ad5933_rblock(AD5933_NINCRH, buf, 2) == 2)
+    if (ad5933_rblock(dev, AD5933_NINCRH, buf, 2) == 2)
         return ((unsigned long int) buf[0] << 8) | buf[1];
     return 0;
 }
 
-int ad5933_set_tsettle(int n, uint8_t m)
+int ad5933_set_tsettle(AD5933 *dev, int n, uint8_t m)
 {
     uint8_t buf[2];
 
-    buf[1] = (uint8_t) n;
+    /*  D8 of the cycle count and the multiplier in D10:D9 */
+    buf[0] = (n >> 8) & 1;
     if (m == 2)
-        buf[0] = (buf[0] & 0xfB) | (1 << 1);
-    if (m == 4)
-        buf[0] = (1 << 1) | (1 << 2);
-    else
-        buf[0] &= 0xf9;
+        buf[0] |= 1 << 1;
+    else if (m == 4)
+        buf[0] |= (1 << 1) | (1 << 2);
+    buf[1] = (uint8_t) n;
 
-    return ad5933_wblock(AD5933_NCYCRH, buf, 2);
+    return ad5933_wblock(dev, AD5933_NCYCRH, buf, 2);
 }
 
 /*  Measurements
  * --------------------------------------------------------------------*/
-int ad5933_get_real(void)
+int ad5933_get_real(AD5933 *dev)
 {
     uint8_t buf[2];
-    if (ad5933_rblock(AD5933_REALDH, buf, 2) == 2)
+    if (ad5933_rblock(dev, AD5933_REALDH, buf, 2) == 2)
         return (int) (((uint16_t) buf[0] << 8) | buf[1]);
     return 0;
 }
 
-int ad5933_get_imaginary(void)
+int ad5933_get_imaginary(AD5933 *dev)
 {
     uint8_t buf[2];
-    if (ad5933_rblock(AD5933_IMAGDH, buf, 2) == 2)
+    if (ad5933_rblock(dev, AD5933_IMAGDH, buf, 2) == 2)
         return (int) (((uint16_t) buf[0] << 8) | buf[1]);
     return 0;
 }
 
-unsigned int ad5933_get_temperature(void)
+unsigned int ad5933_get_temperature(AD5933 *dev)
 {
     uint8_t buf[2];
-    if (ad5933_rblock(AD5933_TEMPRH, buf, 2) == 2)
+    if (ad5933_rblock(dev, AD5933_TEMPRH, buf, 2) == 2)
         return ((unsigned int) buf[0] << 8) | buf[1];
     return 0;
 }
 
 /*  Control functionts
  * --------------------------------------------------------------------*/
-int ad5933_init_with_fstart(void)
+int ad5933_init_with_fstart(AD5933 *dev)
 {
-    ad5933_status.msb = ((ad5933_status.msb & 0x0f) | (1 << 4));
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = ((dev->ctrl[0] & 0x0f) | (1 << 4));
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_start_sweep(void)
+int ad5933_start_sweep(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | (1 << 5);
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | (1 << 5);
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_increment_sweep(void)
+int ad5933_increment_sweep(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | 0x30;
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | 0x30;
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_sweep_complete(void)
+int ad5933_sweep_complete(AD5933 *dev)
 {
-    return ad5933_rbyte(AD5933_STATR) & AD5933_SWEEP_COMPLETE_MASK;
+    return ad5933_rbyte(dev, AD5933_STATR) & AD5933_SWEEP_COMPLETE_MASK;
 }
 
-int ad5933_repeat_frequency(void)
+int ad5933_repeat_frequency(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | (1 << 6);
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | (1 << 6);
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_meas_temperature(void)
+int ad5933_meas_temperature(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | 0x90;
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | 0x90;
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_has_valid_temperature(void)
+int ad5933_has_valid_temperature(AD5933 *dev)
 {
-    return (ad5933_rbyte(AD5933_STATR) & AD5933_VALID_TEMPERATURE_MASK);
+    return (ad5933_rbyte(dev, AD5933_STATR) & AD5933_VALID_TEMPERATURE_MASK);
 }
 
-int ad5933_has_valid_impedance(void)
+int ad5933_has_valid_impedance(AD5933 *dev)
 {
-    return (ad5933_rbyte(AD5933_STATR) & AD5933_VALID_IMPEDANCE_MASK);
+    return (ad5933_rbyte(dev, AD5933_STATR) & AD5933_VALID_IMPEDANCE_MASK);
 }
 
-int ad5933_set_output_range(uint8_t range)
+int ad5933_set_output_range(AD5933 *dev, uint8_t range)
 {
     switch (range) {
         case 1:
-            ad5933_status.msb &= 0xf1;
+            dev->ctrl[0] &= 0xf1;
             break;
         case 4:
-            ad5933_status.msb = (ad5933_status.msb & 0xf1) | (1 << 1);
+            dev->ctrl[0] = (dev->ctrl[0] & 0xf1) | (1 << 1);
             break;
         case 3:
-            ad5933_status.msb = (ad5933_status.msb & 0xf1) | (1 << 2);
+            dev->ctrl[0] = (dev->ctrl[0] & 0xf1) | (1 << 2);
             break;
         case 2:
-            ad5933_status.msb = (ad5933_status.msb & 0xf1) | (1 << 1) | (1 << 2);
+            dev->ctrl[0] = (dev->ctrl[0] & 0xf1) | (1 << 1) | (1 << 2);
             break;
     }
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_set_pga_gain(bool enabled)
+int ad5933_set_pga_gain(AD5933 *dev, bool enabled)
 {
     if (enabled) {
-        ad5933_status.msb |= 1;
+        dev->ctrl[0] |= 1;
     } else {
-        ad5933_status.msb &= ~1;
+        dev->ctrl[0] &= ~1;
     }
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_standby(void)
+int ad5933_standby(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | 0xB0;
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | 0xB0;
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_pwrdown(void)
+int ad5933_pwrdown(AD5933 *dev)
 {
-    ad5933_status.msb = (ad5933_status.msb & 0x0f) | (1 << 7) | (1 << 5);
-    return ad5933_wbyte(AD5933_CTRLRH, ad5933_status.msb);
+    dev->ctrl[0] = (dev->ctrl[0] & 0x0f) | (1 << 7) | (1 << 5);
+    return ad5933_wbyte(dev, AD5933_CTRLRH, dev->ctrl[0]);
 }
 
-int ad5933_reset(void)
+int ad5933_reset(AD5933 *dev)
 {
-    ad5933_status.lsb &= 0x18;
-    return ad5933_wbyte(AD5933_CTRLRL, ad5933_status.lsb | (1 << 4));
+    dev->ctrl[1] &= 0x18;
+    return ad5933_wbyte(dev, AD5933_CTRLRL, dev->ctrl[1] | (1 << 4));
 }
 
@@ -37,6 +37,26 @@
     #define TWI_SLA_AD5933 (0x0D << 1)
 #endif
 
+/*  The address of the AD5933 is fixed, so several parts are connected
+ *  through an I2C multiplexer (TCA9548A or alike), whose single control
+ *  byte enables one bit per downstream channel. */
+#ifndef TWI_SLA_MUX
+    #define TWI_SLA_MUX (0x70 << 1)
+#endif
+
+/*  Device handle. Devices that are not behind the multiplexer have mux = 0.
+ *  ctrl shadows the control register, which cannot be read back in one
+ *  transaction with the bits to be changed. */
+typedef struct AD5933 AD5933;
+
+struct AD5933 {
+    uint8_t sla;
+    uint8_t mux;        // multiplexer channel mask
+    uint8_t ctrl[2];
+};
+
+#define AD5933_DEVICE(mux) { TWI_SLA_AD5933, (mux), {0xA1, 0x00} }
+
 #define AD5933_CLOCK_HZ 16776000
 
 #define AD5933_CTRLRH 0x80 // control register high
@@ -76,56 +96,61 @@
 #define AD5933_VALID_TEMPERATURE_MASK 0x01
 
 /*  Set AD5933's pointer to point paddr */
-int ad5933_set_pointer(uint8_t paddr);
+int ad5933_set_pointer(AD5933 *dev, uint8_t paddr);
 
 /*  Read and write single byte into register address (raddr) */
-int ad5933_wbyte(uint8_t raddr, uint8_t b);
-uint8_t ad5933_rbyte(uint8_t raddr);
+int ad5933_wbyte(AD5933 *dev, uint8_t raddr, uint8_t b);
+uint8_t ad5933_rbyte(AD5933 *dev, uint8_t raddr);
 
 /*  Read and write block starting from register address (raddr).
  *  Returns number of bytes read or write. */
-int ad5933_wblock(uint8_t raddr, uint8_t *buf, uint8_t n);
-int ad5933_rblock(uint8_t raddr, uint8_t *buf, uint8_t n);
+int ad5933_wblock(AD5933 *dev, uint8_t raddr, uint8_t *buf, uint8_t n);
+int ad5933_rblock(AD5933 *dev, uint8_t raddr, uint8_t *buf, uint8_t n);
+
+/*  Convert frequency in Hz to and from the 24-bit code used by the start frequency
+ *  and frequency increment registers, data sheet p. 24 */
+uint32_t ad5933_freq_code(double f);
+double ad5933_freq_hz(uint32_t code);
 
 /*  Set and get 24-bit start frequency code. Setter returns -1 on error. */
-int ad5933_set_fstart(uint32_t f);
-unsigned long int ad5933_get_fstart(void);
-int ad5933_set_fstart_hz(double f);
+int ad5933_set_fstart(AD5933 *dev, uint32_t f);
+unsigned long int ad5933_get_fstart(AD5933 *dev);
+int ad5933_set_fstart_hz(AD5933 *dev, double f);
 
 /*  Set and get 24-bit frequency increment code. Setter returns -1 on error */
-int ad5933_set_fincr(unsigned long int i);
-unsigned long int ad5933_get_fincr(void);
-int ad5933_set_fincr_hz(double f);
+int ad5933_set_fincr(AD5933 *dev, uint32_t i);
+unsigned long int ad5933_get_fincr(AD5933 *dev);
+int ad5933_set_fincr_hz(AD5933 *dev, double f);
 
 /*  Set and get number of frequency increments. Setter returns -1 on error */
-int ad5933_set_nincr(uint16_t n);
-unsigned int ad5933_get_nincr(void);
+int ad5933_set_nincr(AD5933 *dev, uint16_t n);
+unsigned int ad5933_get_nincr(AD5933 *dev);
 
-int ad5933_set_tsettle(int n, uint8_t m);
+int ad5933_set_tsettle(AD5933 *dev, int n, uint8_t m);
 //int ad5933_get_tsettle(void);
 
 /*  Set output range no. Check datasheet p. 22
  *  1 = 2.0 Vpp, 2 = 1.0 Vpp, 3 = 400mVpp, 4 = 200mVpp */
-int ad5933_set_output_range(uint8_t range);
-int ad5933_set_pga_gain(bool enabled);
-
-int ad5933_init_with_fstart(void);
-int ad5933_start_sweep(void);
-int ad5933_increment_sweep(void);
-int ad5933_repeat_frequency(void);
-
-int ad5933_meas_temperature(void);
-int ad5933_has_valid_impedance(void);
-int ad5933_has_valid_temperature(void);
-int ad5933_sweep_complete(void);
-
-int ad5933_standby(void);
-int ad5933_pwrdown(void);
-int ad5933_reset(void);
-
-unsigned int ad5933_get_temperature(void);
-int ad5933_get_real(void);
-int ad5933_get_imaginary(void);
+int ad5933_set_output_range(AD5933 *dev, uint8_t range);
+int ad5933_set_pga_gain(AD5933 *dev, bool enabled);
+
+int ad5933_init_with_fstart(AD5933 *dev);
+int ad5933_start_sweep(AD5933 *dev);
+int ad5933_increment_sweep(AD5933 *dev);
+int ad5933_repeat_frequency(AD5933 *dev);
+
+int ad5933_meas_temperature(AD5933 *dev);
+int ad5933_has_valid_impedance(AD5933 *dev);
+int ad5933_has_valid_temperature(AD5933 *dev);
+int ad5933_sweep_complete(AD5933 *dev);
+
+int ad5933_standby(AD5933 *dev);
+int ad5933_pwrdown(AD5933 *dev);
+int ad5933_reset(AD5933 *dev);
+
+unsigned int ad5933_get_temperature(AD5933 *dev);
+int ad5933_get_real(AD5933 *dev);
+int ad5933_get_imaginary(AD5933 *dev);
 
 #endif
 
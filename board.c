@@ -26,18 +26,29 @@
  */
 #include <avr/io.h>
 #include <avr/power.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include "usart0.h"
+#include "clock.h"
 #include "board.h"
 
+#if BOARD_NDEVICES > 8
+#error The I2C multiplexer has eight channels
+#endif
+
 /*  Setup streams for communication via usart */
 static FILE usart_stream = FDEV_SETUP_STREAM(
     usart0_putchar, usart0_getchar, _FDEV_SETUP_RW);
 
+AD5933 ad5933_devices[BOARD_NDEVICES];
+
 void init_board(void)
 {
+    uint8_t i;
+
     /*  Initialize general io pins */
     DDRB = 0xff;
     PORTB = 0x00;
@@ -46,6 +57,7 @@ void init_board(void)
     power_all_disable();
     power_usart0_enable();
     power_twi_enable();
+    power_timer0_enable();
 
     /*  Initialize usart and declare standard input and output streams */
     init_usart0();
@@ -53,12 +65,18 @@ void init_board(void)
     stderr = stdout;
 
     init_twi();
+    for (i = 0; i < BOARD_NDEVICES; i++)
+        ad5933_devices[i] = (AD5933) AD5933_DEVICE(BOARD_NDEVICES > 1 ? 1 << i : 0);
+
+    /*  Start the system tick */
+    init_timer0();
+    sei();
 }
 
 
 /*  Usart
  * --------------------------------------------------------------------- */
-#define BAUD      19200   // baud rate, see <util/setbaud.h>
+#define BAUD      BOARD_BAUD // baud rate, see <util/setbaud.h>
 #define BOUD_TOL  2       // baud tolerance 2%, see <util/setbaud.h>
 #define USE_2X    0       // don't use prescaler, see <util/setbaud.h>
 #include <util/setbaud.h> // helper macros for baud rate calculations
@@ -76,8 +94,9 @@ void init_usart0(void)
     /*  Asynchronous USART, Parity = none, Stop bits = 1, Data bits = 8 */
     UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
     
-    /*  Enable RX and TX */
-    UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+    /*  Enable RX and TX, and receive interrupt. Transmit interrupt is
+     *  enabled by usart0_putchar() when there is something to send. */
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
 
     /*  Override general io pins for usart rx/tx */
     USART_PORT &= ~_BV(USART_RX);
@@ -93,10 +112,84 @@ void init_usart0(void)
 void init_twi(void)
 {
     /*  TWI clock 100 kHz. Prescaler (in TWSR register) has initial value 1 */
-    TWBR = (F_CPU / 100000UL - 16) / 2;
+    TWBR = (F_CPU / BOARD_TWI_HZ - 16) / 2;
 
     /*  Port pin configuration; i/o = output, state = high, pull-up = no */
     DDRC  |= _BV(TWI_SDA) & _BV(TWI_SCL);
     PORTC |= _BV(PINC4) & _BV(PINC5);
 }
 
+
+/*  Timer0
+ * --------------------------------------------------------------------- */
+#if CLOCK_FINE_PER_TICK > 256
+#error System tick does not fit into 8-bit Timer0, increase CLOCK_PRESCALER
+#endif
+
+void init_timer0(void)
+{
+    /*  CTC mode, compare match interrupt CLOCK_HZ times per second */
+    TCCR0A = _BV(WGM01);
+    OCR0A = CLOCK_FINE_PER_TICK - 1;
+    TIMSK0 = _BV(OCIE0A);
+    TCCR0B = _BV(CS01); // clk/8, CLOCK_PRESCALER
+}
+
+
+/*  Timer1, sample pacing
+ * --------------------------------------------------------------------- */
+int init_timer1(uint16_t hz)
+{
+    static const uint16_t prescalers[] PROGMEM = {1, 8, 64, 256, 1024};
+    uint32_t top;
+    uint8_t cs;
+
+    if (hz == 0)
+        return -1;
+
+    /*  Pick the smallest prescaler for which the period fits into 16 bits */
+    for (cs = 0; cs < 5; cs++) {
+        top = F_CPU / pgm_read_word(&prescalers[cs]) / hz;
+        if (top <= 65536UL)
+            break;
+    }
+    if (cs == 5)
+        return -1;
+
+    power_timer1_enable();
+    TCCR1B = 0;
+    TCCR1A = 0;
+    TCNT1 = 0;
+    OCR1A = top - 1;
+    TIFR1 = _BV(OCF1A);
+    TIMSK1 = _BV(OCIE1A);
+    TCCR1B = _BV(WGM12) | (cs + 1); // CTC mode, CS12:0 = cs + 1
+    return 0;
+}
+
+void stop_timer1(void)
+{
+    TCCR1B = 0;
+    TIMSK1 = 0;
+    power_timer1_disable();
+}
+
+
+/*  External trigger
+ * --------------------------------------------------------------------- */
+#define TRIGGER_PIN DDD2  // INT0
+
+void init_int0(uint8_t edge)
+{
+    DDRD &= ~_BV(TRIGGER_PIN);
+    PORTD |= _BV(TRIGGER_PIN);
+
+    EICRA = (EICRA & ~(_BV(ISC01) | _BV(ISC00))) | (edge & 3);
+    EIFR = _BV(INTF0);
+    EIMSK |= _BV(INT0);
+}
+
+void stop_int0(void)
+{
+    EIMSK &= ~_BV(INT0);
+}
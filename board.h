@@ -27,8 +27,48 @@
 #ifndef __BOARD_H
 #define __BOARD_H
 
+#include <avr/io.h>
+#include <inttypes.h>
+#include "ad5933.h"
+
+/*  Number of AD5933 front-ends. With more than one, device i is connected
+ *  to channel i of the I2C multiplexer. */
+#ifndef BOARD_NDEVICES
+    #define BOARD_NDEVICES 1
+#endif
+
+/*  PORTB pattern of the analog switch that connects the on-board
+ *  reference load instead of the electrodes, and its settling time in ms,
+ *  see ref.h. PB6 and PB7 carry the crystal. */
+#ifndef BOARD_REF_PORT
+    #define BOARD_REF_PORT _BV(PB0)
+#endif
+#define BOARD_REF_SETTLE_MS 2
+
+/*  Console baud rate and TWI clock */
+#define BOARD_BAUD   19200UL
+#define BOARD_TWI_HZ 100000UL
+
+extern AD5933 ad5933_devices[BOARD_NDEVICES];
+
 void init_board(void);
 void init_twi(void);
 void init_usart0(void);
+void init_timer0(void);
+
+/*  Start Timer1 compare match A interrupt hz times per second, and stop it.
+ *  Returns -1 if hz is out of the range of the timer. */
+int init_timer1(uint16_t hz);
+void stop_timer1(void);
+
+/*  Edges of the external trigger input, values of ISC01:0 */
+#define INT0_ANY     1
+#define INT0_FALLING 2
+#define INT0_RISING  3
+
+/*  Enable INT0 (PD2, pulled up) on the given edge, and disable it. Edges
+ *  seen before enabling are discarded. */
+void init_int0(uint8_t edge);
+void stop_int0(void);
 
 #endif
@@ -0,0 +1,65 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <inttypes.h>
+#include "clock.h"
+
+static volatile uint32_t clock_count;
+
+ISR(TIMER0_COMPA_vect)
+{
+    clock_count++;
+}
+
+uint32_t clock_ticks(void)
+{
+    uint32_t t;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        t = clock_count;
+    }
+    return t;
+}
+
+uint32_t clock_fine(void)
+{
+    uint32_t t;
+    uint8_t n;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        t = clock_count;
+        n = TCNT0;
+        /*  The counter has wrapped but the tick is still pending */
+        if (TIFR0 & _BV(OCF0A)) {
+            n = TCNT0;
+            t++;
+        }
+    }
+    return t * CLOCK_FINE_PER_TICK + n;
+}
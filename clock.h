@@ -0,0 +1,50 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include <inttypes.h>
+
+/*  System tick rate. Timer0 runs in CTC mode and interrupts CLOCK_HZ times
+ *  per second, see init_timer0() in board.c. */
+#define CLOCK_HZ 10000UL
+#define CLOCK_TICK_US (1000000UL / CLOCK_HZ)
+#define CLOCK_TICKS_PER_MS (CLOCK_HZ / 1000)
+
+/*  Timer0 clock prescaler. clock_fine() counts at CLOCK_FINE_HZ. */
+#define CLOCK_PRESCALER 8
+#define CLOCK_FINE_HZ (F_CPU / CLOCK_PRESCALER)
+#define CLOCK_FINE_PER_TICK (CLOCK_FINE_HZ / CLOCK_HZ)
+
+/*  Monotonic tick counter since init_board(). Wraps after ~119 hours. */
+uint32_t clock_ticks(void);
+
+/*  Timer0 counts since init_board(), for measuring short intervals.
+ *  Wraps after ~47 minutes at 12 MHz. Safe to call from an ISR. */
+uint32_t clock_fine(void);
+
+#endif
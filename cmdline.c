@@ -0,0 +1,213 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "cmdline.h"
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+int cmd_feed(CmdLine *l, char c)
+{
+    if (c == '\r' || c == '\n') {
+        if (l->len == 0 && !l->overflow)
+            return 0; // skip empty lines and the LF of CR LF
+        l->buf[l->len] = '\0';
+        l->len = 0;
+        if (l->overflow) {
+            l->overflow = false;
+            return -1;
+        }
+        return 1;
+    }
+
+    if (l->len < CMD_LINE_MAX - 1)
+        l->buf[l->len++] = c;
+    else
+        l->overflow = true;
+    return 0;
+}
+
+char *cmd_next(char **line)
+{
+    char *s = *line, *cmd;
+
+    if (s == NULL)
+        return NULL;
+
+    while (is_space(*s))
+        s++;
+    if (*s == '\0') {
+        *line = NULL;
+        return NULL;
+    }
+
+    cmd = s;
+    while (*s != '\0' && *s != ';')
+        s++;
+    if (*s == ';')
+        *s++ = '\0';
+    *line = s;
+    return cmd;
+}
+
+int cmd_tokenize(char *s, char **argv, uint8_t max)
+{
+    uint8_t argc = 0;
+
+    for (;;) {
+        while (is_space(*s))
+            *s++ = '\0';
+        if (*s == '\0')
+            break;
+        if (argc == max)
+            return -1;
+        argv[argc++] = s;
+        while (*s != '\0' && !is_space(*s))
+            s++;
+    }
+    return argc;
+}
+
+char *cmd_value(char *arg)
+{
+    for (; *arg != '\0'; arg++) {
+        if (*arg == '=') {
+            *arg = '\0';
+            return arg + 1;
+        }
+    }
+    return NULL;
+}
+
+int cmd_parse_fixed(const char *s, uint8_t decimals, int32_t *v)
+{
+    bool negative = false, fraction = false, digits = false;
+    uint32_t x = 0;
+
+    if (*s == '-' || *s == '+')
+        negative = (*s++ == '-');
+
+    for (; *s != '\0'; s++) {
+        if (*s == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (*s < '0' || *s > '9')
+            return CMD_ERR_VALUE;
+        if (fraction) {
+            if (decimals == 0)
+                continue; // truncate extra fractional digits
+            decimals--;
+        }
+        if (x > (INT32_MAX - 9) / 10)
+            return CMD_ERR_RANGE;
+        x = x * 10 + (*s - '0');
+        digits = true;
+    }
+    if (!digits)
+        return CMD_ERR_VALUE;
+
+    for (; decimals > 0; decimals--) {
+        if (x > INT32_MAX / 10)
+            return CMD_ERR_RANGE;
+        x *= 10;
+    }
+
+    *v = negative ? -(int32_t) x : (int32_t) x;
+    return CMD_OK;
+}
+
+int cmd_parse_int(const char *s, int32_t min, int32_t max, int32_t *v)
+{
+    int32_t x;
+    int rv;
+
+    if ((rv = cmd_parse_fixed(s, 0, &x)) != CMD_OK)
+        return rv;
+    if (x < min || x > max)
+        return CMD_ERR_RANGE;
+    *v = x;
+    return CMD_OK;
+}
+
+int cmd_parse_options(const cmd_option_t *opts, uint8_t nopts, void *base,
+    uint8_t argc, char **argv)
+{
+    cmd_option_t opt;
+    uint8_t n, i, pos = 0, *field;
+    char *value;
+    int32_t v;
+    int rv;
+
+    for (n = 1; n < argc; n++) {
+        if ((value = cmd_value(argv[n])) != NULL) {
+            for (i = 0; i < nopts; i++)
+                if (strcmp_P(argv[n], opts[i].key) == 0)
+                    break;
+            if (i == nopts)
+                return CMD_ERR_KEY;
+        } else {
+            if (pos == nopts)
+                return CMD_ERR_ARGS;
+            i = pos++;
+            value = argv[n];
+        }
+        memcpy_P(&opt, &opts[i], sizeof(opt));
+
+        rv = cmd_parse_fixed(value, opt.type == CMD_FIX2 ? 2 : 0, &v);
+        if (rv != CMD_OK)
+            return rv;
+        if (v < opt.min || v > opt.max)
+            return CMD_ERR_RANGE;
+
+        field = (uint8_t *) base + opt.offset;
+        switch (opt.type) {
+            case CMD_FIX2:
+                *(double *) field = v / 100.0;
+                break;
+            case CMD_U32:
+                *(uint32_t *) field = v;
+                break;
+            case CMD_U16:
+                *(uint16_t *) field = v;
+                break;
+            case CMD_S16:
+                *(int16_t *) field = v;
+                break;
+            default:
+                *field = v;
+                break;
+        }
+    }
+    return CMD_OK;
+}
@@ -0,0 +1,105 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __CMDLINE_H
+#define __CMDLINE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#define CMD_LINE_MAX 80 // including the terminating null
+#define CMD_MAX_ARGS 10 // including the command itself
+
+/*  Error codes reported as "ERROR <code>" on the console */
+#define CMD_OK          0
+#define CMD_ERR_UNKNOWN 1 // unknown command
+#define CMD_ERR_ARGS    2 // wrong number of arguments
+#define CMD_ERR_KEY     3 // unknown key in key=value argument
+#define CMD_ERR_VALUE   4 // malformed number
+#define CMD_ERR_RANGE   5 // value out of range
+#define CMD_ERR_LINE    6 // line too long
+
+/*  Line assembly state for cmd_feed() */
+typedef struct CmdLine CmdLine;
+
+struct CmdLine {
+    char buf[CMD_LINE_MAX];
+    uint8_t len;
+    bool overflow;
+};
+
+/*  Feed a received character into a line terminated by CR or LF. Empty
+ *  lines are skipped. Returns 1 when a complete line is in l->buf, -1 if
+ *  the line did not fit and was discarded, 0 otherwise. */
+int cmd_feed(CmdLine *l, char c);
+
+/*  Cut the next command off a batch line of commands separated by ';'.
+ *  Returns NULL when there are no more commands. */
+char *cmd_next(char **line);
+
+/*  Split a command into whitespace separated arguments in place.
+ *  Returns the number of arguments or -1 if there are too many. */
+int cmd_tokenize(char *s, char **argv, uint8_t max);
+
+/*  Split "key=value" in place. Returns a pointer to the value or NULL if
+ *  the argument is not in key=value form. */
+char *cmd_value(char *arg);
+
+/*  Parse a decimal number with up to decimals fractional digits into a
+ *  fixed-point integer scaled by 10^decimals, e.g. "12.5" with decimals = 2
+ *  gives 1250. Returns CMD_OK, CMD_ERR_VALUE or CMD_ERR_RANGE. */
+int cmd_parse_fixed(const char *s, uint8_t decimals, int32_t *v);
+
+/*  Parse an integer and check that it lies within [min, max] */
+int cmd_parse_int(const char *s, int32_t min, int32_t max, int32_t *v);
+
+/*  Field types for cmd_option_t */
+#define CMD_U8   1
+#define CMD_U16  2
+#define CMD_U32  3
+#define CMD_FIX2 4 // double given with up to two decimals, min/max scaled by 100
+#define CMD_S16  5
+
+#define CMD_KEY_LEN 9 // including the terminating null
+
+/*  Describes one field of a struct that can be set with key=value. Option
+ *  tables are kept in program memory, declare them PROGMEM. */
+typedef struct {
+    char key[CMD_KEY_LEN];
+    uint8_t offset;
+    uint8_t type;
+    int32_t min;
+    int32_t max;
+} cmd_option_t;
+
+/*  Set fields of the struct at base from argv[1..argc-1]. Arguments may be
+ *  key=value pairs or plain values, which are assigned in table order.
+ *  Stops at the first invalid argument and returns its error code, so
+ *  callers wanting all-or-nothing semantics should pass a copy. */
+int cmd_parse_options(const cmd_option_t *opts, uint8_t nopts, void *base,
+    uint8_t argc, char **argv);
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "delta.h"
+#include "workspace.h"
+
+static struct {
+    uint16_t keyint;
+    uint16_t since_key; // sweeps since the last keyframe
+    bool key;           // current frame is a keyframe
+    bool first;
+} delta;
+
+/*  Previous sweep, as seen by the decoder */
+#define prev (workspace.delta)
+
+static void put_varint(FILE *stream, int32_t v)
+{
+    uint32_t z = ((uint32_t) v << 1) ^ (uint32_t) (v >> 31); // zig-zag
+
+    while (z >= 0x80) {
+        putc((uint8_t) z | 0x80, stream);
+        z >>= 7;
+    }
+    putc((uint8_t) z, stream);
+}
+
+void delta_init(uint16_t keyint)
+{
+    delta.keyint = keyint;
+    delta.first = true;
+
+    /*  Whatever shared the workspace before must not leak into a first
+     *  keyframe that is aborted and padded */
+    memset(prev, 0, sizeof(prev));
+}
+
+void delta_begin(FILE *stream, uint16_t sweep, uint32_t tick, uint16_t npoints)
+{
+    delta.key = delta.first || (delta.keyint && ++delta.since_key >= delta.keyint);
+    if (delta.key)
+        delta.since_key = 0;
+    delta.first = false;
+
+    fprintf_P(stream, PSTR("#%c %u %lu %u\n"), delta.key ? 'K' : 'D', sweep, tick,
+        npoints);
+}
+
+void delta_put(FILE *stream, uint16_t point, int16_t real, int16_t imag)
+{
+    int16_t *p = prev[point % DELTA_MAX_POINTS];
+
+    if (delta.key) {
+        put_varint(stream, real);
+        put_varint(stream, imag);
+    } else {
+        put_varint(stream, (int32_t) real - p[0]);
+        put_varint(stream, (int32_t) imag - p[1]);
+    }
+    p[0] = real;
+    p[1] = imag;
+}
+
+void delta_end(FILE *stream)
+{
+    putc('\n', stream);
+}
+
+void delta_abort(FILE *stream, uint16_t point, uint16_t npoints)
+{
+    int16_t *p;
+
+    for (; point < npoints; point++) {
+        p = prev[point % DELTA_MAX_POINTS];
+        delta_put(stream, point, p[0], p[1]);
+    }
+    delta_end(stream);
+}
@@ -0,0 +1,59 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __DELTA_H
+#define __DELTA_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/*  Sweep-to-sweep delta encoding. Every sweep is sent as a text header
+ *
+ *      #K <sweep> <tick> <npoints>\n   (keyframe) or
+ *      #D <sweep> <tick> <npoints>\n   (delta frame)
+ *
+ *  followed by 2 * npoints binary varints, real and imaginary part of each
+ *  point in turn, and a closing \n. The varints hold zig-zag coded values
+ *  (keyframe) or differences to the same point of the previous sweep
+ *  (delta frame), least significant 7 bits first, MSB set on all but the
+ *  last byte. host/ebi-delta decodes the stream. In a run the header
+ *  replaces the "# <sweep> <tick>" line. */
+#define DELTA_MAX_POINTS 96
+
+/*  Start a new run with a keyframe every keyint sweeps, 0 = only the first */
+void delta_init(uint16_t keyint);
+
+void delta_begin(FILE *stream, uint16_t sweep, uint32_t tick, uint16_t npoints);
+void delta_put(FILE *stream, uint16_t point, int16_t real, int16_t imag);
+void delta_end(FILE *stream);
+
+/*  Complete an aborted frame from point on with the values of the previous
+ *  sweep, so that the decoder always gets whole frames. Points that have
+ *  not been measured in this run yet, i.e. when the first keyframe is
+ *  aborted, are sent as zero. */
+void delta_abort(FILE *stream, uint16_t point, uint16_t npoints);
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "clock.h"
+#include "event.h"
+#include "workspace.h"
+
+#define ZONE_LOW  0
+#define ZONE_MID  1
+#define ZONE_HIGH 2
+
+static struct {
+    uint16_t deadband;
+    uint32_t lo2;       // thresholds squared, compared to |Z|^2
+    uint32_t hi2;
+    uint32_t heartbeat;
+    uint32_t next;      // tick on which the next heartbeat is due
+} cfg;
+
+#define channels (workspace.freerun.event)
+
+void event_init(uint16_t deadband, uint16_t lo, uint16_t hi, uint32_t heartbeat)
+{
+    cfg.deadband = deadband;
+    cfg.lo2 = (uint32_t) lo * lo;
+    cfg.hi2 = (uint32_t) hi * hi;
+    cfg.heartbeat = heartbeat;
+    event_reset();
+}
+
+void event_reset(void)
+{
+    memset(channels, 0, sizeof(channels));
+    cfg.next = clock_ticks() + cfg.heartbeat;
+}
+
+bool event_enabled(void)
+{
+    return cfg.deadband || cfg.lo2 || cfg.hi2 || cfg.heartbeat;
+}
+
+static uint8_t zone(int16_t real, int16_t imag)
+{
+    /*  Each square fits into int32_t, but their sum may not */
+    uint32_t mag2 = (uint32_t) ((int32_t) real * real) + (uint32_t) ((int32_t) imag * imag);
+
+    if (cfg.lo2 && mag2 < cfg.lo2)
+        return ZONE_LOW;
+    if (cfg.hi2 && mag2 > cfg.hi2)
+        return ZONE_HIGH;
+    return ZONE_MID;
+}
+
+bool event_put(uint8_t ch, int16_t real, int16_t imag)
+{
+    EventChannel *c = &channels[ch % EVENT_MAX_CHANNELS];
+    uint8_t z = zone(real, imag);
+    bool report;
+
+    if (c->n < UINT16_MAX) {
+        c->n++;
+        c->sum_real += real;
+        c->sum_imag += imag;
+    }
+
+    if (!c->valid || z != c->zone)
+        report = true;
+    else if (cfg.deadband)
+        report = labs((int32_t) real - c->real) > cfg.deadband
+            || labs((int32_t) imag - c->imag) > cfg.deadband;
+    else
+        report = false;
+
+    if (report) {
+        c->valid = true;
+        c->zone = z;
+        c->real = real;
+        c->imag = imag;
+    }
+    return report;
+}
+
+void event_heartbeat(FILE *stream)
+{
+    uint32_t now = clock_ticks();
+    EventChannel *c;
+    uint8_t ch;
+
+    if (!cfg.heartbeat || (int32_t) (now - cfg.next) < 0)
+        return;
+    cfg.next += cfg.heartbeat;
+    if ((int32_t) (now - cfg.next) >= 0)
+        cfg.next = now + cfg.heartbeat;
+
+    for (ch = 0; ch < EVENT_MAX_CHANNELS; ch++) {
+        c = &channels[ch];
+        if (c->n == 0)
+            continue;
+        fprintf_P(stream, PSTR("# hb %lu %hhu %u %ld %ld\n"), now, ch, c->n,
+            c->sum_real / c->n, c->sum_imag / c->n);
+        c->n = 0;
+        c->sum_real = 0;
+        c->sum_imag = 0;
+    }
+}
@@ -0,0 +1,71 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __EVENT_H
+#define __EVENT_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*  Report-by-exception for freerun. A sample is reported only if it
+ *  differs from the last reported sample of the same channel by more than
+ *  the deadband in either part, or if its magnitude crosses the low or high
+ *  threshold. A heartbeat line summarising all samples since the previous
+ *  one is printed every heartbeat period regardless. One channel per
+ *  frequency of a round-robin freerun, fed with the filter output. */
+#define EVENT_MAX_CHANNELS 4
+
+/*  State of one channel, kept in the acquisition workspace */
+typedef struct EventChannel EventChannel;
+
+struct EventChannel {
+    bool valid;         // baseline has been set
+    uint8_t zone;
+    int16_t real;       // last reported sample
+    int16_t imag;
+    uint16_t n;         // samples since the last heartbeat
+    int32_t sum_real;
+    int32_t sum_imag;
+};
+
+/*  Configure event reporting. Zero disables the respective criterion;
+ *  with everything zero every sample is reported. heartbeat is in ticks. */
+void event_init(uint16_t deadband, uint16_t lo, uint16_t hi, uint32_t heartbeat);
+
+/*  Forget the baselines and restart the heartbeat period */
+void event_reset(void);
+
+bool event_enabled(void);
+
+/*  Returns true if the sample of channel ch has to be reported */
+bool event_put(uint8_t ch, int16_t real, int16_t imag);
+
+/*  Print "# hb <tick> <ch> <samples> <mean R> <mean I>" for the channels
+ *  that got samples, if the heartbeat is due */
+void event_heartbeat(FILE *stream);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "filter.h"
+#include "workspace.h"
+
+/*  Biquad coefficients are Q14, a1 of a low-pass lies within (-2, 0) */
+#define COEFF_SHIFT 14
+#define COEFF_ONE   (1L << COEFF_SHIFT)
+
+static struct {
+    uint8_t order;
+    uint8_t decim;
+    int32_t gain;       // decim ^ order
+    bool lowpass;
+    int16_t b0, b1, b2, a1, a2;
+} cfg;
+
+#define channels (workspace.freerun.filter)
+
+static int16_t clamp16(int32_t v)
+{
+    if (v > INT16_MAX)
+        return INT16_MAX;
+    if (v < INT16_MIN)
+        return INT16_MIN;
+    return v;
+}
+
+int filter_init(uint8_t order, uint8_t decim, double fc)
+{
+    double w0, alpha, c, a0;
+    uint8_t n;
+
+    memset(&cfg, 0, sizeof(cfg));
+    if (order > FILTER_MAX_ORDER || decim == 0 || decim > FILTER_MAX_DECIM
+            || fc < 0 || fc >= 0.5)
+        return -1;
+
+    if (decim > 1 && order > 0) {
+        cfg.order = order;
+        cfg.decim = decim;
+        for (cfg.gain = 1, n = 0; n < order; n++)
+            cfg.gain *= decim;
+    }
+
+    /*  Butterworth low-pass (Q = 1/sqrt(2)), RBJ audio EQ cookbook. b1 is
+     *  derived from the rounded coefficients to keep the DC gain at one. */
+    if (fc > 0) {
+        w0 = 2 * M_PI * fc;
+        c = cos(w0);
+        alpha = sin(w0) / M_SQRT2;
+        a0 = 1 + alpha;
+        cfg.b0 = lround((1 - c) / 2 / a0 * COEFF_ONE);
+        cfg.b2 = cfg.b0;
+        cfg.a1 = lround(-2 * c / a0 * COEFF_ONE);
+        cfg.a2 = lround((1 - alpha) / a0 * COEFF_ONE);
+        cfg.b1 = COEFF_ONE + cfg.a1 + cfg.a2 - 2 * cfg.b0;
+        cfg.lowpass = true;
+    }
+
+    filter_reset();
+    return 0;
+}
+
+void filter_reset(void)
+{
+    memset(channels, 0, sizeof(channels));
+}
+
+bool filter_enabled(void)
+{
+    return cfg.order > 0 || cfg.lowpass;
+}
+
+static bool decimate(FilterChannel *c, int16_t x, int16_t *y)
+{
+    uint32_t v = (int32_t) x, prev;
+    uint8_t n;
+
+    if (cfg.order == 0) {
+        *y = x;
+        return true;
+    }
+
+    /*  Integrators run at the input rate. They may wrap around, the combs
+     *  undo that as long as the output fits into 32 bits. Both are unsigned,
+     *  as signed overflow is undefined, and the two's complement result is
+     *  only read back as signed at the output. */
+    for (n = 0; n < cfg.order; n++)
+        v = c->integ[n] += v;
+    if (++c->phase < cfg.decim)
+        return false;
+    c->phase = 0;
+
+    for (n = 0; n < cfg.order; n++) {
+        prev = c->comb[n];
+        c->comb[n] = v;
+        v -= prev;
+    }
+    *y = clamp16((int32_t) v / cfg.gain);
+    return true;
+}
+
+static int16_t lowpass(FilterChannel *c, int16_t x)
+{
+    int64_t acc;
+
+    /*  Each product fits into int32_t, but near fc = 0.5 the coefficients
+     *  add up to more than 2 and so may their sum */
+    acc = (int64_t) ((int32_t) cfg.b0 * x) + (int32_t) cfg.b1 * c->x[0]
+        + (int32_t) cfg.b2 * c->x[1] - (int32_t) cfg.a1 * c->y[0]
+        - (int32_t) cfg.a2 * c->y[1];
+    c->x[1] = c->x[0];
+    c->x[0] = x;
+    c->y[1] = c->y[0];
+    c->y[0] = clamp16((acc + COEFF_ONE / 2) >> COEFF_SHIFT);
+    return c->y[0];
+}
+
+bool filter_put(uint8_t ch, int16_t x, int16_t *y)
+{
+    FilterChannel *c = &channels[ch % FILTER_MAX_CHANNELS];
+
+    if (!decimate(c, x, y))
+        return false;
+    if (cfg.lowpass)
+        *y = lowpass(c, *y);
+    return true;
+}
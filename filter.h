@@ -0,0 +1,68 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*  Fixed-point filter stage for freerun samples: a CIC decimator of order
+ *  1..FILTER_MAX_ORDER (order 1 is a moving average) followed by a biquad
+ *  low-pass running at the decimated rate. Either stage may be disabled.
+ *  Each frequency of a round-robin freerun uses its own pair of channels
+ *  for the real and imaginary parts. */
+#define FILTER_MAX_ORDER    2
+#define FILTER_MAX_DECIM    64
+#define FILTER_MAX_CHANNELS 8
+
+/*  State of one channel, kept in the acquisition workspace */
+typedef struct FilterChannel FilterChannel;
+
+struct FilterChannel {
+    uint32_t integ[FILTER_MAX_ORDER];   // modulo 2^32, see decimate()
+    uint32_t comb[FILTER_MAX_ORDER];
+    int16_t x[2];
+    int16_t y[2];
+    uint8_t phase;
+};
+
+/*  Configure the filter. order = 0 or decim = 1 disables the decimator,
+ *  fc = 0 the low-pass. fc is the cutoff frequency as a fraction of the
+ *  decimated sample rate and has to be below 0.5. Returns -1 on invalid
+ *  parameters, in which case the filter is disabled. */
+int filter_init(uint8_t order, uint8_t decim, double fc);
+
+/*  Clear the state of all channels */
+void filter_reset(void);
+
+bool filter_enabled(void);
+
+/*  Feed sample x into channel ch. Returns true and stores the filtered
+ *  sample in *y when the decimator produces an output. */
+bool filter_put(uint8_t ch, int16_t x, int16_t *y);
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include "ad5933-sim.h"
+
+extern "C" {
+#include <util/twi.h>
+#include "twi.h"
+}
+
+namespace ebi {
+
+namespace {
+
+const uint8_t SLA_MUX = 0x70 << 1;
+const uint8_t SLA_AD5933 = 0x0D << 1;
+const double MCLK = 16776000;
+const double DFT_US = 1024 / (MCLK / 16) * 1e6;
+
+Sim *current = nullptr;
+
+uint32_t reg24(const uint8_t *r)
+{
+    return uint32_t(r[0]) << 16 | uint32_t(r[1]) << 8 | r[2];
+}
+
+void put16(uint8_t *r, int v)
+{
+    v = std::clamp(v, -32768, 32767);
+    r[0] = uint16_t(v) >> 8;
+    r[1] = uint16_t(v) & 0xff;
+}
+
+} // namespace
+
+Sim::Sim(unsigned nparts, bool mux, double bus_hz)
+    : parts_(nparts), mux_(mux), byte_us_(9e6 / bus_hz)
+{
+    if (nparts == 0 || (!mux && nparts > 1) || nparts > 8)
+        throw std::invalid_argument("invalid number of simulated parts");
+    for (auto &p : parts_) {
+        p.reg[0x80] = 0xA0;     // power-up state: power-down mode
+    }
+}
+
+Sim &Sim::instance()
+{
+    if (!current)
+        throw std::logic_error("no simulated bus installed");
+    return *current;
+}
+
+void Sim::install(Sim *sim)
+{
+    current = sim;
+}
+
+SimPart *Sim::selected()
+{
+    if (!mux_)
+        return &parts_[0];
+    SimPart *p = nullptr;
+    for (unsigned i = 0; i < parts_.size(); i++) {
+        if (!(channels_ & (1 << i)))
+            continue;
+        if (p)
+            return nullptr;     // two parts with the same address
+        p = &parts_[i];
+    }
+    return p;
+}
+
+bool Sim::start(uint8_t sla)
+{
+    now_ += byte_us_ / 9 + byte_us_;
+    stats_.transactions++;
+    stats_.bytes++;
+    reading_ = sla & TW_READ;
+    nbytes_ = 0;
+
+    if (mux_ && (sla & 0xfe) == SLA_MUX)
+        target_ = MUX;
+    else if ((sla & 0xfe) == SLA_AD5933 && selected())
+        target_ = PART;
+    else
+        target_ = NONE;
+    if (target_ == NONE)
+        stats_.nacks++;
+    return target_ != NONE;
+}
+
+bool Sim::write(uint8_t b)
+{
+    now_ += byte_us_;
+    stats_.bytes++;
+    if (target_ == NONE || reading_)
+        return false;
+    if (target_ == MUX) {
+        channels_ = b;
+        return true;
+    }
+
+    SimPart &p = *selected();
+    unsigned n = nbytes_++;
+    if (n == 0) {
+        first_ = b;
+        return true;
+    }
+    switch (first_) {
+        case 0xB0:              // set address pointer
+            p.pointer = b;
+            break;
+        case 0xA1:              // block read of b bytes follows
+            p.block = b;
+            break;
+        case 0xA0:              // block write
+            if (n == 1)
+                count_ = b;
+            else if (n - 1 <= count_)
+                write_register(p, p.pointer++, b);
+            break;
+        default:                // write b into register first_
+            write_register(p, first_, b);
+            break;
+    }
+    return true;
+}
+
+uint8_t Sim::read()
+{
+    now_ += byte_us_;
+    stats_.bytes++;
+    if (target_ == MUX)
+        return channels_;
+    if (target_ != PART)
+        return 0xff;
+
+    SimPart &p = *selected();
+    update(p);
+    uint8_t b = p.reg[p.pointer];
+    if (p.block) {
+        p.pointer++;
+        p.block--;
+    }
+    return b;
+}
+
+void Sim::stop()
+{
+    now_ += byte_us_ / 9;
+    target_ = NONE;
+}
+
+void Sim::write_register(SimPart &p, uint8_t reg, uint8_t b)
+{
+    p.reg[reg] = b;
+    if (reg == 0x80)
+        control(p);
+    else if (reg == 0x81 && (b & 0x10))
+        p.converting = false;   // reset
+}
+
+void Sim::control(SimPart &p)
+{
+    switch (p.reg[0x80] >> 4) {
+        case 0x1:               // initialize with start frequency
+            p.increment = 0;
+            p.converting = false;
+            break;
+        case 0x2:               // start frequency sweep
+            p.increment = 0;
+            schedule(p);
+            break;
+        case 0x3:               // increment frequency
+            p.increment++;
+            schedule(p);
+            break;
+        case 0x4:               // repeat frequency
+            schedule(p);
+            break;
+        case 0x9:               // measure temperature
+            p.temp_done = now_ + 800;
+            break;
+        case 0xA:               // power-down
+        case 0xB:               // standby
+            p.converting = false;
+            break;
+    }
+}
+
+double Sim::frequency(const SimPart &p) const
+{
+    uint32_t code = reg24(&p.reg[0x82]) + p.increment * reg24(&p.reg[0x85]);
+    return code * (MCLK / 536870912.0);
+}
+
+void Sim::schedule(SimPart &p)
+{
+    static const unsigned mult[] = {1, 2, 1, 4};
+    unsigned cycles = ((p.reg[0x8A] & 1) << 8 | p.reg[0x8B]) * mult[(p.reg[0x8A] >> 1) & 3];
+    double f = std::max(frequency(p), 1.0);
+
+    p.converting = true;
+    p.done = now_ + cycles / f * 1e6 + DFT_US;
+    p.reg[0x8F] &= ~0x06;
+}
+
+void Sim::update(SimPart &p)
+{
+    uint16_t nincr = (p.reg[0x88] & 1) << 8 | p.reg[0x89];
+
+    if (p.converting && now_ >= p.done) {
+        /*  Response proportional to the admittance of the load */
+        double w = 2 * M_PI * frequency(p);
+        put16(&p.reg[0x94], int(std::lround(1e7 / p.r)));
+        put16(&p.reg[0x96], int(std::lround(1e7 * w * p.c)));
+        p.converting = false;
+        p.reg[0x8F] |= 0x02;
+        if (p.increment >= nincr)
+            p.reg[0x8F] |= 0x04;
+        stats_.conversions++;
+    }
+    if (p.temp_done >= 0 && now_ >= p.temp_done) {
+        put16(&p.reg[0x92], 25 * 32);
+        p.reg[0x8F] |= 0x01;
+        p.temp_done = -1;
+    }
+}
+
+void Sim::trace(bool on, double fine_hz)
+{
+    tracing_ = on;
+    fine_hz_ = fine_hz;
+    last_event_ = now_;
+    trace_.clear();
+}
+
+void Sim::event(char op, uint8_t data, uint8_t status)
+{
+    if (!tracing_)
+        return;
+    long dt = std::lround((now_ - last_event_) * fine_hz_ / 1e6);
+    last_event_ = now_;
+    trace_.push_back({uint16_t(std::min(dt, 65535L)), op, data, status});
+}
+
+/*  In the format of twi_trace_dump() */
+void Sim::dump_trace(std::FILE *out) const
+{
+    std::fprintf(out, "# twi %zu events, 0 lost, %.0f Hz\n", trace_.size(), fine_hz_);
+    for (const auto &e : trace_)
+        std::fprintf(out, "%u %c %02x %02x\n", e.dt, e.op, e.data, e.status);
+}
+
+} // namespace ebi
+
+/*  twi.h on the simulated bus, with the status codes of <util/twi.h> in
+ *  the trace */
+extern "C" {
+
+uint8_t twi_status;
+
+int twi_sstart(void)
+{
+    return 0;
+}
+
+int twi_start(uint8_t addr, int rwbit)
+{
+    ebi::Sim &sim = ebi::Sim::instance();
+    uint8_t sla = addr | (rwbit == TW_READ);
+    bool ack;
+
+    sim.event('S', 0, 0x08);
+    ack = sim.start(sla);
+    sim.event('A', sla, (rwbit == TW_READ ? 0x40 : 0x18) + (ack ? 0 : 8));
+    return ack ? 1 : -1;
+}
+
+int twi_write(uint8_t *buf, int n)
+{
+    ebi::Sim &sim = ebi::Sim::instance();
+
+    for (int i = 0; i < n; i++) {
+        bool ack = sim.write(buf[i]);
+        sim.event('W', buf[i], ack ? 0x28 : 0x30);
+        if (!ack)
+            return -1;
+    }
+    return n;
+}
+
+int twi_write_byte(uint8_t b)
+{
+    return twi_write(&b, 1);
+}
+
+int twi_read(uint8_t *buf, int n)
+{
+    ebi::Sim &sim = ebi::Sim::instance();
+
+    for (int i = 0; i < n; i++) {
+        buf[i] = sim.read();
+        sim.event('R', buf[i], i < n - 1 ? 0x50 : 0x58);
+    }
+    return n;
+}
+
+uint8_t twi_read_byte(void)
+{
+    uint8_t b;
+
+    twi_read(&b, 1);
+    return b;
+}
+
+void twi_stop(void)
+{
+    ebi::Sim::instance().stop();
+    ebi::Sim::instance().event('P', 0, 0xf8);
+}
+
+void twi_rstart(void)
+{
+}
+
+} // extern "C"
@@ -0,0 +1,129 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+/*  Simulated I2C bus for running the firmware's AD5933 driver on the host.
+ *  The bus carries an I2C multiplexer and any number of AD5933 behind it,
+ *  or a single AD5933 without one. Time is virtual: it advances with each
+ *  bus condition and byte at the bus clock rate, and by advance(). The
+ *  twi_*() functions of twi.h are implemented on top of Sim::instance().
+ *
+ *  Each AD5933 measures a parallel RC load. Conversions take the settling
+ *  cycles at the current frequency plus the 1024 point DFT. */
+#ifndef OPENEBI_AD5933_SIM_H
+#define OPENEBI_AD5933_SIM_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace ebi {
+
+struct SimPart {
+    double r = 1000;            // load, ohm
+    double c = 10e-9;           // farad
+    uint8_t reg[256] = {};
+    uint8_t pointer = 0;
+    uint8_t block = 0;          // bytes left in a block read
+    uint16_t increment = 0;
+    bool converting = false;
+    double done = 0;            // time of the conversion result, us
+    double temp_done = -1;
+};
+
+/*  Bus event in the form of the firmware's TWI trace, see twi.h */
+struct TraceEvent {
+    uint16_t dt;                // clock_fine() counts since the last event
+    char op;                    // S, A, W, R or P
+    uint8_t data;
+    uint8_t status;             // TW_STATUS
+};
+
+struct SimStats {
+    uint64_t transactions = 0;
+    uint64_t bytes = 0;
+    uint64_t nacks = 0;
+    uint64_t conversions = 0;
+};
+
+class Sim {
+public:
+    /*  With mux false there may only be one part */
+    Sim(unsigned nparts, bool mux, double bus_hz = 100000);
+
+    static Sim &instance();
+    static void install(Sim *sim);
+
+    double now() const { return now_; }
+    void advance(double us) { now_ += us; }
+
+    SimPart &part(unsigned i) { return parts_[i]; }
+    unsigned parts() const { return parts_.size(); }
+    const SimStats &stats() const { return stats_; }
+
+    /*  Bus conditions, return false on NACK */
+    bool start(uint8_t sla);
+    bool write(uint8_t b);
+    uint8_t read();
+    void stop();
+
+    /*  Record the bus events of the twi_*() functions as the firmware
+     *  does with TWI_TRACE, timed with a clock_fine() of fine_hz */
+    void trace(bool on, double fine_hz = 1500000);
+    void event(char op, uint8_t data, uint8_t status);
+    void dump_trace(std::FILE *out) const;
+
+private:
+    enum Target { NONE, MUX, PART };
+
+    SimPart *selected();
+    void write_register(SimPart &p, uint8_t reg, uint8_t b);
+    void control(SimPart &p);
+    void schedule(SimPart &p);
+    void update(SimPart &p);
+    double frequency(const SimPart &p) const;
+
+    std::vector<SimPart> parts_;
+    bool mux_;
+    uint8_t channels_ = 0;
+    double byte_us_;
+    double now_ = 0;
+    SimStats stats_;
+
+    Target target_ = NONE;
+    bool reading_ = false;
+    unsigned nbytes_ = 0;       // bytes of the current write transaction
+    uint8_t first_ = 0;
+    uint8_t count_ = 0;         // block write length
+
+    bool tracing_ = false;
+    double fine_hz_ = 0;
+    double last_event_ = 0;
+    std::vector<TraceEvent> trace_;
+};
+
+} // namespace ebi
+
+#endif
@@ -0,0 +1,653 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*  Client library for the OpenEBI serial console, see ebi-client.h */
+#include "ebi-client.h"
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace ebi {
+
+namespace {
+
+const char *skip_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+/*  Parse up to max whitespace separated numbers of [p, end). Returns the
+ *  number parsed or -1 if something else is in the way. */
+int parse_numbers(const char *p, const char *end, double *v, int max)
+{
+    int n = 0;
+
+    for (p = skip_space(p, end); p < end; p = skip_space(p, end)) {
+        if (n == max)
+            return -1;
+        auto res = std::from_chars(p, end, v[n]);
+        if (res.ec != std::errc() || (res.ptr < end && *res.ptr != ' ' && *res.ptr != '\t'))
+            return -1;
+        p = res.ptr;
+        n++;
+    }
+    return n;
+}
+
+speed_t baud_code(unsigned baud)
+{
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default: return B0;
+    }
+}
+
+bool starts_with(const char *s, const char *end, const char *prefix)
+{
+    size_t n = std::strlen(prefix);
+    return size_t(end - s) >= n && std::memcmp(s, prefix, n) == 0;
+}
+
+} // namespace
+
+/*  Link */
+
+Link::~Link()
+{
+    close();
+}
+
+bool Link::open_serial(const char *path, unsigned baud, Flow flow)
+{
+    struct termios tio;
+    speed_t speed = baud_code(baud);
+
+    close();
+    if (speed == B0) {
+        errno = EINVAL;
+        return false;
+    }
+    if ((fd_ = ::open(path, O_RDWR | O_NOCTTY | O_NONBLOCK)) == -1)
+        return false;
+    if (tcgetattr(fd_, &tio) == -1) {
+        close();
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    if (flow == Flow::XONXOFF)
+        tio.c_iflag |= IXOFF;
+    if (flow == Flow::RTSCTS)
+        tio.c_cflag |= CRTSCTS;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    if (tcsetattr(fd_, TCSANOW, &tio) == -1) {
+        close();
+        return false;
+    }
+    tcflush(fd_, TCIOFLUSH);
+    file_ = false;
+    return true;
+}
+
+bool Link::open_file(const char *path)
+{
+    close();
+    if ((fd_ = ::open(path, O_RDONLY)) == -1)
+        return false;
+    file_ = true;
+    return true;
+}
+
+void Link::close()
+{
+    if (fd_ != -1)
+        ::close(fd_);
+    fd_ = -1;
+}
+
+long Link::read(char *buf, size_t n, int timeout_ms)
+{
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    ssize_t len;
+
+    if (fd_ == -1)
+        return -1;
+    if (!file_) {
+        switch (poll(&pfd, 1, timeout_ms)) {
+            case -1:
+                return (errno == EINTR) ? 0 : -1;
+            case 0:
+                return 0;
+        }
+    }
+    if ((len = ::read(fd_, buf, n)) == -1)
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    if (len == 0)
+        return -1; // end of file or hangup
+    if (record_ != nullptr)
+        std::fwrite(buf, 1, len, record_);
+    return len;
+}
+
+bool Link::write(const char *buf, size_t n)
+{
+    struct pollfd pfd = {fd_, POLLOUT, 0};
+    ssize_t len;
+
+    if (file_)
+        return fd_ != -1; // a recording ignores commands
+    while (n > 0) {
+        if ((len = ::write(fd_, buf, n)) == -1) {
+            if (errno == EAGAIN)
+                poll(&pfd, 1, -1);
+            else if (errno != EINTR)
+                return false;
+            continue;
+        }
+        buf += len;
+        n -= len;
+    }
+    return true;
+}
+
+bool Link::send_line(const char *line)
+{
+    return write(line, std::strlen(line)) && write("\n", 1);
+}
+
+bool Link::send_escape()
+{
+    return write("\x1b", 1);
+}
+
+/*  Layout */
+
+Layout layout_for(const char *cmd)
+{
+    Layout layout = Layout::RI;
+    char c;
+
+    /*  The last command of a batch that prints samples decides */
+    while (*cmd != '\0') {
+        bool tag = false, slot = false, stats = false, zoom = false;
+
+        while (std::isspace((unsigned char)*cmd))
+            cmd++;
+        c = *cmd;
+        while (*cmd != '\0' && *cmd != ';') {
+            char key[16];
+            size_t n = 0;
+            long value = 0;
+
+            while (*cmd != '\0' && *cmd != ';' && !std::isspace((unsigned char)*cmd))
+                cmd++;
+            while (std::isspace((unsigned char)*cmd))
+                cmd++;
+            if (*cmd == '\0' || *cmd == ';')
+                break;
+
+            while (std::isalnum((unsigned char)cmd[n]) && n < sizeof(key) - 1) {
+                key[n] = cmd[n];
+                n++;
+            }
+            key[n] = '\0';
+            if (cmd[n] == '=')
+                value = std::strtol(cmd + n + 1, nullptr, 10);
+            else if (std::isdigit((unsigned char)*cmd))
+                std::strcpy(key, "f1"); // positional frequency
+            else
+                continue;
+
+            if (std::strcmp(key, "stats") == 0)
+                stats = value != 0;
+            else if (std::strcmp(key, "zoom") == 0)
+                zoom = value != 0;
+            else if (std::strcmp(key, "scan") == 0)
+                tag = value != 0;
+            else if (std::strcmp(key, "dev") == 0)
+                tag = value > 1;
+            else if (std::strcmp(key, "rate") == 0)
+                slot = value != 0;
+            else if (key[0] == 'f' && key[1] >= '1' && key[1] <= '4' && key[2] == '\0')
+                tag = true;
+        }
+
+        if (c == 's' || c == 'a')
+            layout = stats ? Layout::STATS : zoom ? Layout::F_RI
+                : tag ? Layout::TAG_RI : Layout::RI;
+        else if (c == 'f')
+            layout = slot ? (tag ? Layout::SLOT_TAG_RI : Layout::SLOT_RI)
+                : (tag ? Layout::TAG_RI : Layout::RI);
+
+        if (*cmd == ';')
+            cmd++;
+    }
+    return layout;
+}
+
+/*  Parser */
+
+void Parser::reset()
+{
+    len_ = 0;
+    overflow_ = false;
+    frame_ = false;
+    have_key_ = false;
+    point_ = 0;
+    sample_ = Sample();
+}
+
+bool Parser::next(const char *&p, const char *end, Record &r)
+{
+    while (p < end) {
+        char c = *p++;
+
+        if (frame_) {
+            if (frame_byte(uint8_t(c), r))
+                return true;
+            if (frame_ || c == '\n')
+                continue;
+            /*  A frame not closed by a newline, c starts the next line */
+        }
+
+        if (c == '\n') {
+            if (line(r))
+                return true;
+            continue;
+        }
+        if (c == '\r')
+            continue;
+
+        if (len_ < sizeof(line_) - 1)
+            line_[len_++] = c;
+        else
+            overflow_ = true;
+
+        /*  The prompt is not followed by a newline */
+        if (len_ == 2 && line_[0] == '$' && line_[1] == ' ') {
+            len_ = 0;
+            r.kind = Record::PROMPT;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Parser::line(Record &r)
+{
+    const char *end = line_ + len_;
+    bool overflow = overflow_;
+
+    line_[len_] = '\0';
+    len_ = 0;
+    overflow_ = false;
+
+    if (line_ == end)
+        return false;
+    r.text = line_;
+    r.kind = Record::OTHER;
+    if (overflow)
+        return true;
+
+    if (starts_with(line_, end, "ERROR ")) {
+        r.kind = Record::ERROR;
+        r.error = std::atoi(line_ + 6);
+        return true;
+    }
+    if (starts_with(line_, end, "#K ") || starts_with(line_, end, "#D ")) {
+        /*  Frames are reported sample by sample, those that cannot be
+         *  decoded as a whole by their header line */
+        return !frame_header() || skip_;
+    }
+    if (line_[0] == '#') {
+        double v[3];
+
+        if (parse_numbers(line_ + 1, end, v, 3) == 2) {
+            sample_.sweep = uint32_t(v[0]);
+            sample_.tick = uint32_t(v[1]);
+            point_ = 0;
+        }
+        r.kind = Record::COMMENT;
+        return true;
+    }
+    sample_line(r);
+    return true;
+}
+
+bool Parser::sample_line(Record &r)
+{
+    static const int columns[] = {2, 3, 4, 5, 3, 4};
+    const char *end = line_ + std::strlen(line_);
+    Sample &s = sample_;
+    double v[5];
+    int n = columns[int(layout_)], i = 0;
+
+    if (parse_numbers(line_, end, v, 5) != n)
+        return false;
+
+    switch (layout_) {
+        case Layout::SLOT_RI:
+        case Layout::SLOT_TAG_RI:
+            s.seq = uint32_t(v[i++]);
+            s.tick = uint32_t(v[i++]);
+            break;
+        case Layout::F_RI:
+            s.f = v[i++];
+            break;
+        default:
+            break;
+    }
+    if (layout_ == Layout::TAG_RI || layout_ == Layout::SLOT_TAG_RI)
+        s.tag = int(v[i++]);
+    s.real = v[i++];
+    s.imag = v[i++];
+    if (layout_ == Layout::STATS) {
+        s.ci[0] = v[i++];
+        s.ci[1] = v[i++];
+    }
+
+    s.index = point_++;
+    r.kind = Record::SAMPLE;
+    r.sample = &s;
+    samples_++;
+    return true;
+}
+
+/*  "#K <sweep> <tick> <npoints>" or "#D ..." */
+bool Parser::frame_header()
+{
+    const char *end = line_ + std::strlen(line_);
+    double v[4];
+    unsigned npoints;
+
+    if (parse_numbers(line_ + 3, end, v, 4) != 3)
+        return false;
+    npoints = unsigned(v[2]);
+    key_ = line_[1] == 'K';
+    skip_ = npoints > MAX_POINTS || (!key_ && (!have_key_ || npoints != npoints_));
+
+    sample_ = Sample();
+    sample_.sweep = uint32_t(v[0]);
+    sample_.tick = uint32_t(v[1]);
+    if (!skip_)
+        npoints_ = npoints;
+    values_ = 2 * npoints;
+    value_ = 0;
+    z_ = 0;
+    shift_ = 0;
+    frame_ = true;
+    if (key_)
+        have_key_ = false;
+    return true;
+}
+
+/*  Decode a byte of a frame, closing it on the byte after the last value */
+bool Parser::frame_byte(uint8_t c, Record &r)
+{
+    int32_t v;
+
+    if (value_ == values_) {
+        frame_ = false;
+        have_key_ = have_key_ || !skip_;
+        return false;
+    }
+
+    z_ |= uint32_t(c & 0x7f) << shift_;
+    shift_ += 7;
+    if ((c & 0x80) && shift_ < 35)
+        return false;
+
+    v = int32_t(z_ >> 1) ^ -int32_t(z_ & 1); // zig-zag
+    if (!skip_)
+        prev_[value_] = key_ ? v : prev_[value_] + v;
+    z_ = 0;
+    shift_ = 0;
+    if (++value_ & 1 || skip_)
+        return false;
+
+    sample_.index = value_ / 2 - 1;
+    sample_.real = prev_[value_ - 2];
+    sample_.imag = prev_[value_ - 1];
+    r.kind = Record::SAMPLE;
+    r.sample = &sample_;
+    samples_++;
+    return true;
+}
+
+/*  Calibration */
+
+void Calibration::set(size_t point, double rcal, double real, double imag)
+{
+    double mag = std::hypot(real, imag);
+
+    if (point >= gain_.size()) {
+        gain_.resize(point + 1, 0);
+        phase_.resize(point + 1, 0);
+    }
+    gain_[point] = (mag > 0 && rcal > 0) ? 1 / (rcal * mag) : 0;
+    phase_[point] = std::atan2(imag, real);
+}
+
+bool Calibration::load(const char *path)
+{
+    std::FILE *in = std::fopen(path, "r");
+    double gain, phase;
+
+    if (in == nullptr)
+        return false;
+    clear();
+    while (std::fscanf(in, "%lf %lf", &gain, &phase) == 2) {
+        gain_.push_back(gain);
+        phase_.push_back(phase);
+    }
+    std::fclose(in);
+    return !empty();
+}
+
+bool Calibration::save(const char *path) const
+{
+    std::FILE *out = std::fopen(path, "w");
+
+    if (out == nullptr)
+        return false;
+    for (size_t i = 0; i < gain_.size(); i++)
+        std::fprintf(out, "%.9g %.9g\n", gain_[i], phase_[i]);
+    return std::fclose(out) == 0;
+}
+
+void Calibration::apply(size_t point, double real, double imag, double &mag, double &phase) const
+{
+    double m = std::hypot(real, imag);
+
+    if (gain_.size() == 1)
+        point = 0;
+    if (point >= gain_.size() || gain_[point] == 0 || m == 0) {
+        mag = phase = 0;
+        return;
+    }
+    mag = 1 / (gain_[point] * m);
+    phase = std::atan2(imag, real) - phase_[point];
+}
+
+/*  CsvWriter */
+
+CsvWriter::~CsvWriter()
+{
+    close();
+}
+
+bool CsvWriter::open(const char *path)
+{
+    close();
+    out_ = (std::strcmp(path, "-") == 0) ? stdout : std::fopen(path, "w");
+    if (out_ == nullptr)
+        return false;
+    buf_.resize(1 << 20);
+    std::setvbuf(out_, buf_.data(), _IOFBF, buf_.size());
+    std::fputs("sweep,index,seq,tick,tag,f,real,imag,ci_real,ci_imag,mag,phase\n", out_);
+    return true;
+}
+
+/*  std::to_chars formats without locale or allocation, several times
+ *  faster than fprintf */
+void CsvWriter::write(const Sample &s, double mag, double phase)
+{
+    char line[256], *p = line;
+    auto put = [&](auto v, char sep) {
+        p = std::to_chars(p, line + sizeof(line) - 1, v).ptr; // fields fit
+        *p++ = sep;
+    };
+
+    put(s.sweep, ',');
+    put(s.index, ',');
+    put(s.seq, ',');
+    put(s.tick, ',');
+    put(s.tag, ',');
+    put(s.f, ',');
+    put(s.real, ',');
+    put(s.imag, ',');
+    put(s.ci[0], ',');
+    put(s.ci[1], ',');
+    put(mag, ',');
+    put(phase, '\n');
+    std::fwrite(line, 1, p - line, out_);
+}
+
+void CsvWriter::close()
+{
+    if (out_ == nullptr)
+        return;
+    if (out_ == stdout)
+        std::fflush(out_), std::setvbuf(out_, nullptr, _IOLBF, 0);
+    else
+        std::fclose(out_);
+    out_ = nullptr;
+}
+
+/*  BinaryLog */
+
+BinaryLog::~BinaryLog()
+{
+    close();
+}
+
+bool BinaryLog::open(const char *path)
+{
+    LogHeader h = {"EBILOG1", sizeof(LogRecord), 0};
+
+    close();
+    if ((fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+        return false;
+    if (!grow()) {
+        close();
+        return false;
+    }
+    std::memcpy(map_, &h, sizeof(h));
+    size_ = sizeof(h);
+    return true;
+}
+
+/*  Double the mapped size, starting at 1 MB */
+bool BinaryLog::grow()
+{
+    size_t capacity = capacity_ ? 2 * capacity_ : size_t(1) << 20;
+    void *map;
+
+    if (map_ != nullptr)
+        munmap(map_, capacity_);
+    map_ = nullptr;
+    if (ftruncate(fd_, capacity) == -1)
+        return false;
+    map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED)
+        return false;
+    map_ = static_cast<char *>(map);
+    capacity_ = capacity;
+    return true;
+}
+
+bool BinaryLog::write(const Sample &s, double mag, double phase)
+{
+    LogRecord r = {s.sweep, s.index, s.seq, s.tick, s.tag, float(s.real), float(s.imag),
+        float(mag), float(phase)};
+
+    if (size_ + sizeof(r) > capacity_ && !grow())
+        return false;
+    std::memcpy(map_ + size_, &r, sizeof(r));
+    size_ += sizeof(r);
+    return true;
+}
+
+bool BinaryLog::close()
+{
+    bool ok = true;
+
+    if (fd_ == -1)
+        return true;
+    if (map_ != nullptr)
+        munmap(map_, capacity_);
+    ok = ftruncate(fd_, size_) == 0;
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    map_ = nullptr;
+    size_ = capacity_ = 0;
+    return ok;
+}
+
+uint64_t BinaryLog::records() const
+{
+    return size_ > sizeof(LogHeader) ? (size_ - sizeof(LogHeader)) / sizeof(LogRecord) : 0;
+}
+
+/*  Client */
+
+int Client::sync(int timeout_ms)
+{
+    if (!link_.send_escape())
+        return LINK_EOF;
+    return run(nullptr, Layout::RI, [](const Record &) {}, timeout_ms);
+}
+
+} // namespace ebi
@@ -0,0 +1,338 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*  Client library for the OpenEBI serial console.
+ *
+ *  Link reads and writes a serial device, a pty or a recorded stream.
+ *  Parser splits the stream into records: samples, comment lines, the
+ *  prompt and errors. Text lines are assembled in a fixed buffer and delta
+ *  frames (see delta.h) decoded into a fixed array, so no memory is
+ *  allocated per sample. Client sends commands and passes the records of
+ *  their output to a sink until the prompt returns. Calibration turns raw
+ *  samples into impedance, and CsvWriter and BinaryLog store the results.
+ *
+ *  ebi-log.cpp is the command line front-end. */
+#ifndef OPENEBI_EBI_CLIENT_H
+#define OPENEBI_EBI_CLIENT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <csignal>
+#include <cstdio>
+#include <vector>
+
+namespace ebi {
+
+/*  Errors of Client::run() besides the firmware error codes of cmdline.h */
+const int LINK_EOF = -1;
+const int LINK_TIMEOUT = -2;
+
+/*  Flow control of the serial link, numbered as the firmware's c flow=.
+ *  With XONXOFF the host sends XOFF when its input queue fills up, but
+ *  does not react to them itself, as delta frames may contain either. */
+enum class Flow { NONE, XONXOFF, RTSCTS };
+
+class Link {
+public:
+    Link() = default;
+    ~Link();
+    Link(const Link &) = delete;
+    Link &operator=(const Link &) = delete;
+
+    /*  Serial device or pty in raw 8N1 mode. Return false with errno set
+     *  on failure. */
+    bool open_serial(const char *path, unsigned baud, Flow flow = Flow::NONE);
+    bool open_file(const char *path);
+    void close();
+    bool is_file() const { return file_; }
+
+    /*  Copy everything read into a recording */
+    void record(std::FILE *out) { record_ = out; }
+
+    /*  Read what is available, waiting up to timeout_ms for the first
+     *  byte (-1 = forever). Returns the number of bytes, 0 on timeout or
+     *  signal and -1 at the end of a file or on error. */
+    long read(char *buf, size_t n, int timeout_ms);
+
+    bool write(const char *buf, size_t n);
+    bool send_line(const char *line);
+    bool send_escape();
+
+private:
+    int fd_ = -1;
+    bool file_ = false;
+    std::FILE *record_ = nullptr;
+};
+
+/*  Columns of sample lines, which depend on the command that produced
+ *  them. Delta frames always decode to RI. */
+enum class Layout {
+    RI,             // "R I": sweeps, plain freerun
+    TAG_RI,         // "i R I": round-robin, multi-device freerun, scan
+    SLOT_RI,        // "seq tick R I": paced freerun
+    SLOT_TAG_RI,    // "seq tick i R I": paced round-robin
+    F_RI,           // "f R I": zoom
+    STATS           // "R I ciR ciI": sweep statistics
+};
+
+/*  Layout of the output of a console command, e.g. "f rate=100" */
+Layout layout_for(const char *cmd);
+
+struct Sample {
+    uint32_t sweep = 0;     // from "# <sweep> <tick>" and frame headers
+    uint32_t index = 0;     // point of the sweep, or sample of the run
+    uint32_t seq = 0;       // paced slot
+    uint32_t tick = 0;      // slot or sweep tick
+    int tag = -1;           // frequency, device or channel, -1 = none
+    double f = 0;           // zoom frequency in Hz
+    double real = 0;
+    double imag = 0;
+    double ci[2] = {0, 0};  // statistics confidence intervals
+};
+
+struct Record {
+    enum Kind { SAMPLE, COMMENT, OTHER, ERROR, PROMPT };
+
+    Kind kind = OTHER;
+    const Sample *sample = nullptr; // SAMPLE
+    const char *text = nullptr;     // COMMENT, OTHER: the line without newline
+    int error = 0;                  // ERROR
+};
+
+class Parser {
+public:
+    /*  Largest sweep of a delta frame, DELTA_MAX_POINTS of the firmware
+     *  with room to spare */
+    static const unsigned MAX_POINTS = 256;
+
+    void set_layout(Layout layout) { layout_ = layout; }
+
+    /*  Forget the sweep, point and delta frame state of the last run */
+    void reset();
+
+    /*  Consume bytes of [p, end) up to and including the next complete
+     *  record. Returns false when the input runs out first. The record
+     *  refers to the parser and is valid until the next call. A delta
+     *  frame that cannot be decoded, e.g. #D before any #K, is consumed
+     *  and reported as its header line of kind OTHER. */
+    bool next(const char *&p, const char *end, Record &r);
+
+    uint64_t samples() const { return samples_; }
+
+private:
+    bool line(Record &r);
+    bool sample_line(Record &r);
+    bool frame_header();
+    bool frame_byte(uint8_t c, Record &r);
+
+    Layout layout_ = Layout::RI;
+    char line_[256];
+    size_t len_ = 0;
+    bool overflow_ = false;
+    uint32_t point_ = 0;        // next point of a text sweep
+
+    /*  Delta frame being decoded */
+    bool frame_ = false;        // inside the binary part of a frame
+    bool key_ = false;
+    bool have_key_ = false;     // prev_ holds a complete sweep
+    bool skip_ = false;         // frame cannot be decoded, consume only
+    unsigned values_ = 0;       // values of the frame
+    unsigned value_ = 0;        // next value
+    unsigned npoints_ = 0;
+    uint32_t z_ = 0;
+    unsigned shift_ = 0;
+    std::array<int32_t, 2 * MAX_POINTS> prev_{};
+
+    Sample sample_;
+    uint64_t samples_ = 0;
+};
+
+/*  Gain factor calibration of the AD5933 data sheet. Measuring a resistor
+ *  of rcal ohm gives the gain factor 1 / (rcal * |DFT|) and the system
+ *  phase of every point, which turn later samples of the same point into
+ *  |Z| = 1 / (gain * |DFT|) and the phase of Z. With only one point
+ *  calibrated, it is used for all. */
+class Calibration {
+public:
+    void clear() { gain_.clear(); phase_.clear(); }
+    bool empty() const { return gain_.empty(); }
+    size_t points() const { return gain_.size(); }
+
+    void set(size_t point, double rcal, double real, double imag);
+
+    /*  Text file of "<gain> <phase>" lines, one per point */
+    bool load(const char *path);
+    bool save(const char *path) const;
+
+    void apply(size_t point, double real, double imag, double &mag, double &phase) const;
+
+private:
+    std::vector<double> gain_;
+    std::vector<double> phase_;
+};
+
+/*  Point of a sample for calibration: the tag if there is one, else the
+ *  point of the sweep */
+inline size_t calibration_point(const Sample &s, Layout layout)
+{
+    if (s.tag >= 0)
+        return s.tag;
+    return (layout == Layout::RI || layout == Layout::F_RI || layout == Layout::STATS)
+        ? s.index : 0;
+}
+
+class CsvWriter {
+public:
+    ~CsvWriter();
+    bool open(const char *path);    // "-" = stdout
+    void write(const Sample &s, double mag, double phase);
+    void close();
+
+private:
+    std::FILE *out_ = nullptr;
+    std::vector<char> buf_;
+};
+
+/*  Memory-mapped binary log: a LogHeader followed by LogRecords in host
+ *  byte order. The file grows in steps and is cut to size on close(). */
+struct LogHeader {
+    char magic[8];          // "EBILOG1"
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+struct LogRecord {
+    uint32_t sweep;
+    uint32_t index;
+    uint32_t seq;
+    uint32_t tick;
+    int32_t tag;
+    float real;
+    float imag;
+    float mag;              // 0 if not calibrated
+    float phase;
+};
+
+class BinaryLog {
+public:
+    ~BinaryLog();
+    bool open(const char *path);
+    bool write(const Sample &s, double mag, double phase);
+    bool close();
+    uint64_t records() const;
+
+private:
+    bool grow();
+
+    int fd_ = -1;
+    char *map_ = nullptr;
+    size_t size_ = 0;       // bytes used
+    size_t capacity_ = 0;   // bytes mapped
+};
+
+class Client {
+public:
+    explicit Client(Link &link) : link_(link) {}
+
+    Parser &parser() { return parser_; }
+
+    /*  Send cmd, unless it is null, and pass every sample, comment and
+     *  other line to sink until the prompt returns. Returns 0, the
+     *  firmware error code of an "ERROR <code>" line, LINK_TIMEOUT if
+     *  nothing arrives for timeout_ms (-1 = forever) or LINK_EOF. */
+    template <class Sink>
+    int run(const char *cmd, Layout layout, Sink &&sink, int timeout_ms = 5000);
+
+    /*  Abort the running command and wait for the prompt */
+    int sync(int timeout_ms = 2000);
+
+    /*  Make run() abort the command on the board and return once the
+     *  prompt is back. Safe to call from a signal handler. */
+    void request_abort() { abort_ = 1; }
+
+private:
+    Link &link_;
+    Parser parser_;
+    char buf_[4096];
+    const char *p_ = buf_;
+    const char *end_ = buf_;
+    volatile std::sig_atomic_t abort_ = 0;
+};
+
+template <class Sink>
+int Client::run(const char *cmd, Layout layout, Sink &&sink, int timeout_ms)
+{
+    const int slice = 100;
+    int error = 0, idle = 0;
+    bool aborting = false;
+    Record r;
+    long n;
+
+    parser_.set_layout(layout);
+    if (cmd != nullptr) {
+        parser_.reset();
+        if (!link_.send_line(cmd))
+            return LINK_EOF;
+    }
+
+    for (;;) {
+        while (parser_.next(p_, end_, r)) {
+            switch (r.kind) {
+                case Record::PROMPT:
+                    abort_ = 0;
+                    return error;
+                case Record::ERROR:
+                    error = r.error;
+                    break;
+                default:
+                    sink(r);
+                    break;
+            }
+        }
+        if (abort_ && !aborting && !link_.is_file()) {
+            link_.send_escape();
+            aborting = true;
+        }
+
+        n = link_.read(buf_, sizeof(buf_), link_.is_file() ? -1 : slice);
+        if (n < 0)
+            return LINK_EOF;
+        if (n == 0) {
+            idle += slice;
+            if (timeout_ms >= 0 && idle >= timeout_ms)
+                return LINK_TIMEOUT;
+            continue;
+        }
+        idle = 0;
+        p_ = buf_;
+        end_ = buf_ + n;
+    }
+}
+
+} // namespace ebi
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*  Decodes the delta encoded sweep stream of 's delta=<k>' (see delta.h)
+ *  back into the text format of a repeated sweep:
+ *
+ *      # <sweep> <tick>
+ *      R I
+ *      ...
+ *
+ *  Lines outside of frames are passed through unchanged.
+ *
+ *  Usage: ebi-delta [file]   (reads stdin if no file is given) */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+bool get_varint(std::FILE *in, int32_t &v)
+{
+    uint32_t z = 0;
+    int c, shift = 0;
+
+    do {
+        if ((c = std::fgetc(in)) == EOF || shift > 28)
+            return false;
+        z |= uint32_t(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    v = int32_t(z >> 1) ^ -int32_t(z & 1); // zig-zag
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::FILE *in = stdin;
+    std::vector<int32_t> prev;
+    char line[256];
+    unsigned sweep, npoints;
+    unsigned long tick;
+    char kind;
+
+    if (argc > 1 && (in = std::fopen(argv[1], "rb")) == nullptr) {
+        std::perror(argv[1]);
+        return 1;
+    }
+
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        if (std::sscanf(line, "#%c %u %lu %u", &kind, &sweep, &tick, &npoints) != 4
+                || (kind != 'K' && kind != 'D')) {
+            std::fputs(line, stdout);
+            continue;
+        }
+        if (kind == 'D' && prev.size() != 2 * npoints) {
+            std::fprintf(stderr, "sweep %u: delta frame without keyframe\n", sweep);
+            return 1;
+        }
+        prev.resize(2 * npoints);
+
+        std::printf("# %u %lu\n", sweep, tick);
+        for (unsigned n = 0; n < 2 * npoints; n++) {
+            int32_t v;
+            if (!get_varint(in, v)) {
+                std::fprintf(stderr, "sweep %u: truncated frame\n", sweep);
+                return 1;
+            }
+            prev[n] = (kind == 'K') ? v : prev[n] + v;
+        }
+        for (unsigned n = 0; n < npoints; n++)
+            std::printf("%d %d\n", int(prev[2 * n]), int(prev[2 * n + 1]));
+
+        if (std::fgetc(in) != '\n') {
+            std::fprintf(stderr, "sweep %u: frame not terminated\n", sweep);
+            return 1;
+        }
+    }
+    return 0;
+}
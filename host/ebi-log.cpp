@@ -0,0 +1,395 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*  Logs measurements of an OpenEBI board with the client library of
+ *  ebi-client.h. Runs the console commands given with -c one after the
+ *  other and writes every sample to a CSV file and/or a memory-mapped
+ *  binary log, converted to |Z| and phase with the calibration of -k.
+ *  Comment lines of the firmware go to stderr.
+ *
+ *  Instead of a serial device -r replays a raw recording of the stream
+ *  made with -s, so the library can be tested and timed without hardware.
+ *  -g and -G write synthetic recordings of text or delta coded sweeps,
+ *  and -B times parsing a recording held in memory against the rate of
+ *  the serial link.
+ *
+ *  Usage: ebi-log [-d dev] [-b baud] [-F flow] [-r recording] [-c cmd]...
+ *                 [-l layout] [-k calfile] [-K rcal] [-o csv] [-m log] [-s raw]
+ *                 [-t ms] [-q]
+ *         ebi-log -r recording -B n [-l layout] [-k calfile] [-o csv] [-m log]
+ *         ebi-log -g sweeps | -G sweeps
+ *
+ *  Layouts are ri, tag, slot, slot-tag, f and stats, see ebi-client.h. The
+ *  default follows from the command. -K rcal calibrates with a resistor of
+ *  rcal ohm and saves the result to the -k file. -F 1 or 2 enables XON/XOFF
+ *  or RTS/CTS flow control, which the board has to be set to with c flow=.
+ *  Samples the board reports lost with "# lost <n>" are counted. */
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "ebi-client.h"
+
+namespace {
+
+struct Options {
+    const char *device = "/dev/ttyUSB0";
+    unsigned baud = 19200;
+    ebi::Flow flow = ebi::Flow::NONE;
+    const char *recording = nullptr;
+    std::vector<const char *> commands;
+    const char *layout = nullptr;
+    const char *calfile = nullptr;
+    double rcal = 0;
+    const char *csv = nullptr;
+    const char *log = nullptr;
+    const char *raw = nullptr;
+    int timeout = 10000;                // ms, 0 = forever
+    bool quiet = false;
+    unsigned bench = 0;
+    unsigned text_sweeps = 0;
+    unsigned delta_sweeps = 0;
+};
+
+/*  Sink of Client::run(): calibrates samples and writes them out */
+struct Output {
+    ebi::Layout layout = ebi::Layout::RI;
+    ebi::Calibration cal;
+    double rcal = 0;                    // calibrating
+    ebi::CsvWriter csv;
+    ebi::BinaryLog log;
+    bool to_csv = false;
+    bool to_log = false;
+    bool quiet = false;
+    unsigned long long lost = 0;
+
+    void operator()(const ebi::Record &r)
+    {
+        const ebi::Sample *s = r.sample;
+        double mag = 0, phase = 0;
+
+        if (r.kind != ebi::Record::SAMPLE) {
+            if (r.kind == ebi::Record::COMMENT && std::strncmp(r.text, "# lost ", 7) == 0)
+                lost += std::strtoull(r.text + 7, nullptr, 10);
+            if (!quiet)
+                std::fprintf(stderr, "%s\n", r.text);
+            return;
+        }
+        if (rcal > 0)
+            cal.set(ebi::calibration_point(*s, layout), rcal, s->real, s->imag);
+        cal.apply(ebi::calibration_point(*s, layout), s->real, s->imag, mag, phase);
+        if (to_csv)
+            csv.write(*s, mag, phase);
+        if (to_log)
+            log.write(*s, mag, phase);
+    }
+};
+
+ebi::Client *running = nullptr;
+
+void interrupt(int)
+{
+    if (running != nullptr)
+        running->request_abort();
+}
+
+bool parse_layout(const char *name, ebi::Layout &layout)
+{
+    static const struct {
+        const char *name;
+        ebi::Layout layout;
+    } layouts[] = {
+        {"ri", ebi::Layout::RI},
+        {"tag", ebi::Layout::TAG_RI},
+        {"slot", ebi::Layout::SLOT_RI},
+        {"slot-tag", ebi::Layout::SLOT_TAG_RI},
+        {"f", ebi::Layout::F_RI},
+        {"stats", ebi::Layout::STATS}
+    };
+
+    for (const auto &l : layouts) {
+        if (std::strcmp(name, l.name) == 0) {
+            layout = l.layout;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*  Synthetic spectrum of a single dispersion with some noise, in the
+ *  counts of a 96 point sweep */
+void synthetic_point(unsigned sweep, unsigned point, int &real, int &imag)
+{
+    static uint32_t seed = 1;
+    double w = point / 30.0, drift = (sweep % 100) * 0.5;
+
+    seed = seed * 1103515245 + 12345;
+    real = int(3000 + drift + 1000 / (1 + w * w)) + int(seed >> 16 & 7) - 3;
+    imag = int(-800 * w / (1 + w * w)) + int(seed >> 20 & 7) - 3;
+}
+
+void put_varint(int32_t v, std::FILE *out)
+{
+    uint32_t z = (uint32_t(v) << 1) ^ uint32_t(v >> 31); // zig-zag
+
+    while (z >= 0x80) {
+        std::fputc(int(z & 0x7f) | 0x80, out);
+        z >>= 7;
+    }
+    std::fputc(int(z), out);
+}
+
+/*  The stream of 's count=<sweeps>' or 's count=<sweeps> delta=10' in
+ *  between two prompts, as recorded by -s */
+void generate(unsigned sweeps, bool delta, std::FILE *out)
+{
+    const unsigned npoints = 96, keyint = 10;
+    std::vector<int> prev(2 * npoints);
+    int real, imag;
+
+    std::fputs("$ ", out);
+    for (unsigned s = 1; s <= sweeps; s++) {
+        unsigned long tick = 1000UL * s;
+        bool key = (s - 1) % keyint == 0;
+
+        if (delta)
+            std::fprintf(out, "#%c %u %lu %u\n", key ? 'K' : 'D', s, tick, npoints);
+        else
+            std::fprintf(out, "# %u %lu\n", s, tick);
+        for (unsigned n = 0; n < npoints; n++) {
+            synthetic_point(s, n, real, imag);
+            if (!delta) {
+                std::fprintf(out, "%d %d\n", real, imag);
+                continue;
+            }
+            put_varint(key ? real : real - prev[2 * n], out);
+            put_varint(key ? imag : imag - prev[2 * n + 1], out);
+            prev[2 * n] = real;
+            prev[2 * n + 1] = imag;
+        }
+        if (delta)
+            std::fputc('\n', out);
+    }
+    std::fprintf(out, "# %u sweeps\n$ ", sweeps);
+}
+
+/*  Parse the recording n times from memory through out */
+int benchmark(const Options &o, Output &out)
+{
+    std::FILE *in = std::fopen(o.recording, "rb");
+    std::vector<char> data;
+    char buf[65536];
+    size_t n;
+
+    if (in == nullptr) {
+        std::perror(o.recording);
+        return 1;
+    }
+    while ((n = std::fread(buf, 1, sizeof(buf), in)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    std::fclose(in);
+
+    ebi::Parser parser;
+    ebi::Record r;
+    auto start = std::chrono::steady_clock::now();
+
+    parser.set_layout(out.layout);
+    for (unsigned i = 0; i < o.bench; i++) {
+        const char *p = data.data(), *end = p + data.size();
+
+        parser.reset();
+        while (parser.next(p, end, r))
+            if (r.kind == ebi::Record::SAMPLE)
+                out(r);
+    }
+
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    double bytes = double(data.size()) * o.bench;
+    double link = o.baud / 10.0;        // bytes per second with 8N1
+
+    std::printf("%.0f bytes, %llu samples in %.3f s\n", bytes,
+        (unsigned long long)parser.samples(), t.count());
+    std::printf("%.1f MB/s, %.0f samples/s, %.0f x the %u baud link\n",
+        bytes / t.count() / 1e6, parser.samples() / t.count(),
+        bytes / t.count() / link, o.baud);
+    return 0;
+}
+
+const char *describe(int rv)
+{
+    static char error[16];
+
+    switch (rv) {
+        case ebi::LINK_EOF: return "end of stream";
+        case ebi::LINK_TIMEOUT: return "timeout";
+    }
+    std::snprintf(error, sizeof(error), "ERROR %d", rv);
+    return error;
+}
+
+int run(const Options &o, Output &out)
+{
+    ebi::Link link;
+    ebi::Client client(link);
+    std::FILE *raw = nullptr;
+    struct sigaction sa = {};
+    int timeout = o.timeout ? o.timeout : -1, rv;
+
+    if (o.recording ? !link.open_file(o.recording) : !link.open_serial(o.device, o.baud, o.flow)) {
+        std::perror(o.recording ? o.recording : o.device);
+        return 1;
+    }
+    if (o.raw != nullptr) {
+        if ((raw = std::fopen(o.raw, "wb")) == nullptr) {
+            std::perror(o.raw);
+            return 1;
+        }
+        link.record(raw);
+    }
+
+    /*  No SA_RESTART, so that the interrupted poll() returns */
+    sa.sa_handler = interrupt;
+    sigaction(SIGINT, &sa, nullptr);
+    running = &client;
+
+    if ((rv = client.sync(o.recording ? -1 : 2000)) != 0) {
+        std::fprintf(stderr, "%s: no prompt (%s)\n", o.recording ? o.recording : o.device,
+            describe(rv));
+        return 1;
+    }
+
+    for (const char *cmd : o.commands) {
+        if (o.layout == nullptr)
+            out.layout = ebi::layout_for(cmd);
+        if ((rv = client.run(cmd, out.layout, out, timeout)) != 0) {
+            std::fprintf(stderr, "%s: %s\n", cmd, describe(rv));
+            break;
+        }
+    }
+
+    /*  A recording without commands is replayed to the end */
+    if (o.recording != nullptr && o.commands.empty())
+        while ((rv = client.run(nullptr, out.layout, out, -1)) >= 0)
+            ;
+
+    running = nullptr;
+    if (raw != nullptr)
+        std::fclose(raw);
+    if (!o.quiet)
+        std::fprintf(stderr, "%llu samples, %llu lost\n",
+            (unsigned long long)client.parser().samples(), out.lost);
+    return (rv == 0 || (o.recording != nullptr && o.commands.empty())) ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    Output out;
+    int c, rv;
+
+    while ((c = getopt(argc, argv, "d:b:F:r:c:l:k:K:o:m:s:t:qB:g:G:")) != -1) {
+        switch (c) {
+            case 'd': o.device = optarg; break;
+            case 'b': o.baud = std::atoi(optarg); break;
+            case 'F': o.flow = ebi::Flow(std::atoi(optarg)); break;
+            case 'r': o.recording = optarg; break;
+            case 'c': o.commands.push_back(optarg); break;
+            case 'l': o.layout = optarg; break;
+            case 'k': o.calfile = optarg; break;
+            case 'K': o.rcal = std::atof(optarg); break;
+            case 'o': o.csv = optarg; break;
+            case 'm': o.log = optarg; break;
+            case 's': o.raw = optarg; break;
+            case 't': o.timeout = std::atoi(optarg); break;
+            case 'q': o.quiet = true; break;
+            case 'B': o.bench = std::atoi(optarg); break;
+            case 'g': o.text_sweeps = std::atoi(optarg); break;
+            case 'G': o.delta_sweeps = std::atoi(optarg); break;
+            default:
+                std::fprintf(stderr, "usage: %s [-d dev] [-b baud] [-F flow] [-r recording]"
+                    " [-c cmd]... [-l layout]\n\t[-k calfile] [-K rcal] [-o csv] [-m log] [-s raw] [-t ms]"
+                    " [-q] [-B n] [-g|-G sweeps]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (o.text_sweeps || o.delta_sweeps) {
+        generate(o.text_sweeps ? o.text_sweeps : o.delta_sweeps, o.delta_sweeps, stdout);
+        return 0;
+    }
+
+    if (o.layout != nullptr && !parse_layout(o.layout, out.layout)) {
+        std::fprintf(stderr, "%s: unknown layout\n", o.layout);
+        return 2;
+    }
+    if (o.flow != ebi::Flow::NONE && o.flow != ebi::Flow::XONXOFF
+            && o.flow != ebi::Flow::RTSCTS) {
+        std::fprintf(stderr, "-F is 0 (none), 1 (XON/XOFF) or 2 (RTS/CTS)\n");
+        return 2;
+    }
+    if (o.rcal > 0 && o.calfile == nullptr) {
+        std::fprintf(stderr, "-K needs a calibration file (-k)\n");
+        return 2;
+    }
+    if (o.bench && o.recording == nullptr) {
+        std::fprintf(stderr, "-B needs a recording (-r)\n");
+        return 2;
+    }
+    if (o.calfile != nullptr && o.rcal <= 0 && !out.cal.load(o.calfile)) {
+        std::fprintf(stderr, "%s: no calibration\n", o.calfile);
+        return 1;
+    }
+    out.rcal = o.rcal;
+    out.quiet = o.quiet || o.bench;
+    if (o.csv != nullptr && !(out.to_csv = out.csv.open(o.csv))) {
+        std::perror(o.csv);
+        return 1;
+    }
+    if (o.log != nullptr && !(out.to_log = out.log.open(o.log))) {
+        std::perror(o.log);
+        return 1;
+    }
+
+    rv = o.bench ? benchmark(o, out) : run(o, out);
+
+    out.csv.close();
+    if (out.to_log && !out.log.close()) {
+        std::perror(o.log);
+        rv = 1;
+    }
+    if (o.rcal > 0 && rv == 0) {
+        if (out.cal.empty() || !out.cal.save(o.calfile)) {
+            std::fprintf(stderr, "%s: calibration not saved\n", o.calfile);
+            rv = 1;
+        }
+    }
+    return rv;
+}
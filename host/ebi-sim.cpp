@@ -0,0 +1,234 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+/*  Runs the firmware's AD5933 driver against simulated parts behind an
+ *  I2C multiplexer (see ad5933-sim.h) and compares the throughput of
+ *  measuring the parts one at a time with interleaving their conversions
+ *  the way 'f dev=<n>' does. Polling follows acquire.c: a part is not
+ *  polled before CONVERSION_TICKS have passed, and an idle main loop
+ *  waits for the next system tick.
+ *
+ *  -T writes the bus trace of the interleaved run for host/ebi-twi.
+ *
+ *  Usage: ebi-sim [-n parts] [-s samples] [-t settle] [-f hz] [-b baud] [-v]
+ *                 [-T trace] */
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+#include "ad5933-sim.h"
+
+extern "C" {
+#include "ad5933.h"
+}
+
+namespace {
+
+const double TICK_US = 100;             // CLOCK_HZ 10000
+const double CONVERSION_US = 1000;      // CONVERSION_TICKS
+
+struct Options {
+    unsigned parts = 4;
+    unsigned samples = 1000;            // per part
+    unsigned settle = 10;
+    double freq = 50000;
+    unsigned baud = 19200;
+    bool verbose = false;
+    const char *trace = nullptr;
+};
+
+struct Result {
+    double us = 0;
+    unsigned samples = 0;
+    unsigned chars = 0;                 // of "d R I" output lines
+    std::vector<double> real, imag;     // means per part
+};
+
+void setup(ebi::Sim &sim, std::vector<AD5933> &dev, const Options &o)
+{
+    for (unsigned i = 0; i < o.parts; i++) {
+        sim.part(i).r = 1000.0 * (i + 1);
+        sim.part(i).c = 1e-9 * (i + 1);
+        dev.push_back(AD5933_DEVICE(uint8_t(1 << i)));
+    }
+    for (auto &d : dev) {
+        ad5933_reset(&d);
+        ad5933_set_fstart_hz(&d, o.freq);
+        ad5933_set_nincr(&d, 0);
+        ad5933_set_fincr(&d, 0);
+        ad5933_set_tsettle(&d, o.settle, 1);
+        ad5933_set_output_range(&d, 1);
+        ad5933_set_pga_gain(&d, true);
+        ad5933_standby(&d);
+    }
+}
+
+void sample(Result &res, AD5933 &d, unsigned i)
+{
+    int16_t r = int16_t(ad5933_get_real(&d));
+    int16_t im = int16_t(ad5933_get_imaginary(&d));
+    char line[32];
+
+    res.real[i] += r;
+    res.imag[i] += im;
+    res.chars += std::snprintf(line, sizeof(line), "%u %d %d\n", i, r, im);
+    res.samples++;
+}
+
+/*  One conversion in flight at a time */
+Result sequential(const Options &o)
+{
+    ebi::Sim sim(o.parts, true);
+    std::vector<AD5933> dev;
+    Result res;
+
+    ebi::Sim::install(&sim);
+    setup(sim, dev, o);
+    res.real.assign(o.parts, 0);
+    res.imag.assign(o.parts, 0);
+    for (auto &d : dev)
+        ad5933_init_with_fstart(&d);
+
+    double t0 = sim.now();
+    for (unsigned n = 0; n < o.samples; n++) {
+        for (unsigned i = 0; i < o.parts; i++) {
+            if (n == 0)
+                ad5933_start_sweep(&dev[i]);
+            else
+                ad5933_repeat_frequency(&dev[i]);
+            sim.advance(CONVERSION_US);
+            while (!ad5933_has_valid_impedance(&dev[i]))
+                sim.advance(TICK_US);
+            sample(res, dev[i], i);
+        }
+    }
+    res.us = sim.now() - t0;
+    return res;
+}
+
+/*  Every part restarted as soon as it has been read, see multi_task() */
+Result interleaved(const Options &o)
+{
+    ebi::Sim sim(o.parts, true);
+    std::vector<AD5933> dev;
+    std::vector<double> t(o.parts);
+    std::vector<unsigned> left(o.parts, o.samples);
+    unsigned busy = o.parts;
+    Result res;
+
+    ebi::Sim::install(&sim);
+    sim.trace(o.trace != nullptr);
+    setup(sim, dev, o);
+    res.real.assign(o.parts, 0);
+    res.imag.assign(o.parts, 0);
+
+    double t0 = sim.now();
+    for (unsigned i = 0; i < o.parts; i++) {
+        ad5933_init_with_fstart(&dev[i]);
+        ad5933_start_sweep(&dev[i]);
+        t[i] = sim.now();
+    }
+    while (busy) {
+        bool polled = false;
+        for (unsigned i = 0; i < o.parts; i++) {
+            if (!left[i] || sim.now() - t[i] < CONVERSION_US)
+                continue;
+            polled = true;
+            if (!ad5933_has_valid_impedance(&dev[i]))
+                continue;
+            sample(res, dev[i], i);
+            if (--left[i])
+                ad5933_repeat_frequency(&dev[i]);
+            else
+                busy--;
+            t[i] = sim.now();
+        }
+        if (!polled)
+            sim.advance(TICK_US);
+    }
+    res.us = sim.now() - t0;
+    if (o.trace != nullptr) {
+        std::FILE *out = std::fopen(o.trace, "w");
+
+        if (out != nullptr) {
+            sim.dump_trace(out);
+            std::fclose(out);
+        } else {
+            std::perror(o.trace);
+        }
+    }
+    return res;
+}
+
+void report(const char *name, const Result &res, const Options &o)
+{
+    double rate = res.samples / (res.us * 1e-6);
+    double link = o.baud / 10.0 / (double(res.chars) / res.samples);
+
+    std::printf("%-12s %u samples in %.3f s, %.1f samples/s (link limit %.1f)\n",
+        name, res.samples, res.us * 1e-6, rate, link);
+    if (o.verbose)
+        for (unsigned i = 0; i < o.parts; i++)
+            std::printf("  %u R %.1f I %.1f\n", i, res.real[i] / o.samples,
+                res.imag[i] / o.samples);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:t:f:b:vT:")) != -1) {
+        switch (c) {
+            case 'n': o.parts = std::atoi(optarg); break;
+            case 's': o.samples = std::atoi(optarg); break;
+            case 't': o.settle = std::atoi(optarg); break;
+            case 'f': o.freq = std::atof(optarg); break;
+            case 'b': o.baud = std::atoi(optarg); break;
+            case 'v': o.verbose = true; break;
+            case 'T': o.trace = optarg; break;
+            default:
+                std::fprintf(stderr, "usage: %s [-n parts] [-s samples] [-t settle]"
+                    " [-f hz] [-b baud] [-v] [-T trace]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (o.parts < 1 || o.parts > 8 || o.samples < 1) {
+        std::fprintf(stderr, "%s: 1..8 parts and at least one sample\n", argv[0]);
+        return 2;
+    }
+
+    std::printf("# %u parts, %u samples each, %u settling cycles at %.2f Hz\n",
+        o.parts, o.samples, o.settle, o.freq);
+    Result seq = sequential(o);
+    report("sequential", seq, o);
+    Result il = interleaved(o);
+    report("interleaved", il, o);
+    std::printf("# speedup %.2f\n", seq.us / il.us);
+    return 0;
+}
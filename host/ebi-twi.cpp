@@ -0,0 +1,251 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*  Replays a TWI bus trace of the firmware (see twi.h) on the simulated
+ *  bus of ad5933-sim.h, so bus problems of a field unit can be reproduced
+ *  and timed without the hardware. The input is a console log holding one
+ *  or more dumps of the 'd' command, or a trace written by 'ebi-sim -T'.
+ *
+ *  Every event is replayed no earlier than it was recorded. Addresses and
+ *  written bytes are checked for the same ACK/NACK as on the board, read
+ *  bytes against the simulated parts, and the recorded time per byte is
+ *  compared with the bus clock, which gives the MCU overhead per byte.
+ *  Traces with more than 65535 clock_fine() counts between two events,
+ *  e.g. waiting for a conversion, replay those gaps shortened.
+ *
+ *  Exits with 1 if the ACKs differ or the trace holds bus errors.
+ *
+ *  Usage: ebi-twi [-n parts] [-c bus hz] [-v] [file] */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "ad5933-sim.h"
+
+namespace {
+
+const uint8_t SLA_MUX = 0x70 << 1;
+
+/*  Status codes of <util/twi.h> */
+const uint8_t TW_START = 0x08;
+const uint8_t TW_REP_START = 0x10;
+const uint8_t TW_MT_SLA_ACK = 0x18;
+const uint8_t TW_MT_DATA_ACK = 0x28;
+const uint8_t TW_MR_SLA_ACK = 0x40;
+const uint8_t TW_MR_DATA_ACK = 0x50;
+const uint8_t TW_MR_DATA_NACK = 0x58;
+
+struct Options {
+    unsigned parts = 0;                 // 0 = 4 behind a multiplexer or 1
+    double bus_hz = 100000;
+    bool verbose = false;
+};
+
+struct Dump {
+    double fine_hz = 0;
+    unsigned long lost = 0;
+    std::vector<ebi::TraceEvent> events;
+};
+
+struct Report {
+    unsigned long events = 0;
+    unsigned long transactions = 0;
+    unsigned long lost = 0;
+    double recorded_us = 0;
+    double byte_us = 0;                 // recorded, summed over bytes
+    unsigned long bytes = 0;
+    unsigned long late = 0;             // events the bus could not keep up with
+    double max_late_us = 0;
+    unsigned long ack_mismatches = 0;
+    unsigned long read_differences = 0;
+    unsigned long bus_errors = 0;
+};
+
+bool read_dumps(std::FILE *in, std::vector<Dump> &dumps)
+{
+    char line[128], op;
+    unsigned dt, data, status;
+    unsigned long lost;
+    double hz;
+
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        if (std::sscanf(line, "# twi %*u events, %lu lost, %lf Hz", &lost, &hz) == 2) {
+            dumps.push_back(Dump());
+            dumps.back().fine_hz = hz;
+            dumps.back().lost = lost;
+            continue;
+        }
+        if (dumps.empty()
+                || std::sscanf(line, "%u %c %x %x", &dt, &op, &data, &status) != 4
+                || std::strchr("SAWRP", op) == nullptr)
+            continue;
+        dumps.back().events.push_back({uint16_t(dt), op, uint8_t(data), uint8_t(status)});
+    }
+    return !dumps.empty();
+}
+
+bool uses_mux(const std::vector<Dump> &dumps)
+{
+    for (const auto &d : dumps)
+        for (const auto &e : d.events)
+            if (e.op == 'A' && (e.data & 0xfe) == SLA_MUX)
+                return true;
+    return false;
+}
+
+void replay(ebi::Sim &sim, const Dump &d, const Options &o, Report &rep)
+{
+    const double bit_us = 1e6 / o.bus_hz;
+    double t = sim.now();
+
+    rep.lost += d.lost;
+    for (const auto &e : d.events) {
+        double dt = e.dt / d.fine_hz * 1e6, duration = 0;
+        const char *note = "";
+        bool ack;
+
+        switch (e.op) {
+            case 'A': duration = 10 * bit_us; break;
+            case 'W':
+            case 'R': duration = 9 * bit_us; break;
+            case 'P': duration = bit_us; break;
+        }
+        t += dt;
+        rep.events++;
+        rep.recorded_us += dt;
+        if (sim.now() + duration < t)
+            sim.advance(t - duration - sim.now());
+
+        switch (e.op) {
+            case 'S':
+                if (e.status != TW_START && e.status != TW_REP_START) {
+                    rep.bus_errors++;
+                    note = " bus error";
+                }
+                break;
+            case 'A':
+                rep.transactions++;
+                ack = sim.start(e.data);
+                if (ack != (e.status == TW_MT_SLA_ACK || e.status == TW_MR_SLA_ACK)) {
+                    rep.ack_mismatches++;
+                    note = ack ? " ACK, NACK recorded" : " NACK, ACK recorded";
+                }
+                break;
+            case 'W':
+                ack = sim.write(e.data);
+                if (ack != (e.status == TW_MT_DATA_ACK)) {
+                    rep.ack_mismatches++;
+                    note = ack ? " ACK, NACK recorded" : " NACK, ACK recorded";
+                }
+                rep.byte_us += dt;
+                rep.bytes++;
+                break;
+            case 'R':
+                if (e.status != TW_MR_DATA_ACK && e.status != TW_MR_DATA_NACK) {
+                    rep.bus_errors++;
+                    note = " bus error";
+                } else if (sim.read() != e.data) {
+                    rep.read_differences++;
+                    note = " differs";
+                }
+                rep.byte_us += dt;
+                rep.bytes++;
+                break;
+            case 'P':
+                sim.stop();
+                break;
+        }
+
+        if (sim.now() > t + bit_us) {
+            rep.late++;
+            if (sim.now() - t > rep.max_late_us)
+                rep.max_late_us = sim.now() - t;
+        }
+        if (o.verbose)
+            std::printf("%12.1f %12.1f %c %02x %02x%s\n", t, sim.now(), e.op, e.data,
+                e.status, note);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options o;
+    Report rep;
+    std::vector<Dump> dumps;
+    std::FILE *in = stdin;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:c:v")) != -1) {
+        switch (c) {
+            case 'n': o.parts = std::atoi(optarg); break;
+            case 'c': o.bus_hz = std::atof(optarg); break;
+            case 'v': o.verbose = true; break;
+            default:
+                std::fprintf(stderr, "usage: %s [-n parts] [-c bus hz] [-v] [file]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc && (in = std::fopen(argv[optind], "r")) == nullptr) {
+        std::perror(argv[optind]);
+        return 1;
+    }
+    if (!read_dumps(in, dumps)) {
+        std::fprintf(stderr, "no TWI trace found\n");
+        return 1;
+    }
+
+    bool mux = uses_mux(dumps);
+    if (o.parts == 0)
+        o.parts = mux ? 4 : 1;
+    if (o.parts > 8 || (!mux && o.parts > 1)) {
+        std::fprintf(stderr, "%s: 1 part, or up to 8 behind a multiplexer\n", argv[0]);
+        return 2;
+    }
+
+    ebi::Sim sim(o.parts, mux, o.bus_hz);
+    ebi::Sim::install(&sim);
+    for (const auto &d : dumps) {
+        replay(sim, d, o, rep);
+        sim.stop(); // dumps are not contiguous
+    }
+
+    const double bit_us = 1e6 / o.bus_hz;
+    std::printf("# %zu dumps, %lu events, %lu lost\n", dumps.size(), rep.events, rep.lost);
+    std::printf("recorded %.3f ms, %lu transactions, %lu bytes\n", rep.recorded_us / 1000,
+        rep.transactions, rep.bytes);
+    if (rep.bytes)
+        std::printf("byte     %.1f us recorded, %.1f us at %.0f Hz, %.1f us overhead\n",
+            rep.byte_us / rep.bytes, 9 * bit_us, o.bus_hz, rep.byte_us / rep.bytes - 9 * bit_us);
+    std::printf("replayed %.3f ms, %lu events late (max %.1f us)\n", sim.now() / 1000,
+        rep.late, rep.max_late_us);
+    std::printf("checks   %lu ACK mismatches, %lu read differences, %lu bus errors,"
+        " %llu conversions\n", rep.ack_mismatches, rep.read_differences, rep.bus_errors,
+        (unsigned long long)sim.stats().conversions);
+    return (rep.ack_mismatches || rep.bus_errors) ? 1 : 0;
+}
@@ -34,10 +34,26 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 
 #include "board.h"
 #include "usart0.h"
+#include "clock.h"
+#include "settings.h"
+#include "cmdline.h"
+#include "acquire.h"
+#include "filter.h"
+#include "event.h"
+#include "delta.h"
+#include "stats.h"
+#include "zoom.h"
+#include "scan.h"
+#include "power.h"
+#include "plan.h"
+#include "mem.h"
+#include "twi.h"
 #include "ad5933.h"
 
 // #define __ASSERT_USE_STDERR 1
@@ -69,169 +85,842 @@
 //     return;
 // }
 
-typedef struct SweepOptions SweepOptions;
-
-struct SweepOptions {
-    double fstart;
-    double fincr;
-    uint16_t nincr;
-    uint16_t tsettle;
-    uint8_t xtsettle;
-    uint8_t nrange;
-    uint8_t pgagain;
-    uint8_t average;
-};
+static void init_device(AD5933 *dev, SweepOptions *o)
+{
+    ad5933_reset(dev);
+    ad5933_set_fstart_hz(dev, o->fstart);
+    ad5933_set_nincr(dev, o->nincr);
+    ad5933_set_fincr_hz(dev, o->fincr);
+    ad5933_set_tsettle(dev, o->tsettle, o->xtsettle);
+    ad5933_set_output_range(dev, o->nrange);
+    ad5933_set_pga_gain(dev, o->pgagain);
+    ad5933_standby(dev);
+}
 
+/*  All front-ends are programmed with the same options */
 void init_ad5933(SweepOptions *o)
 {
-    ad5933_reset();
-    ad5933_set_fstart_hz(o->fstart);
-    ad5933_set_nincr(o->nincr);
-    ad5933_set_fincr_hz(o->fincr);
-    ad5933_set_tsettle(o->tsettle, o->xtsettle);
-    ad5933_set_output_range(o->nrange);
-    ad5933_set_pga_gain(o->pgagain);
-    ad5933_standby();
+    uint8_t i;
+
+    for (i = 0; i < BOARD_NDEVICES; i++)
+        init_device(&ad5933_devices[i], o);
 }
 
-void take_measurement(uint8_t avg, double *rdata, double *idata)
+static uint8_t update_device(AD5933 *dev, SweepOptions *active, SweepOptions *o)
 {
-    int i;
-    int32_t rdata_raw = 0, idata_raw = 0;
-
-    for (i = 0; i < avg; i++) {
-        _delay_ms(1); // The conversion process takes approximately 1 ms using a 16.777 MHz clock.
-        while (!ad5933_has_valid_impedance());
-        rdata_raw += ad5933_get_real();
-        idata_raw += ad5933_get_imaginary();
+    uint8_t n = 0;
 
-        if (avg > 1) {
-            ad5933_repeat_frequency();
-        }
+    if (o->fstart != active->fstart) {
+        ad5933_set_fstart_hz(dev, o->fstart);
+        n++;
+    }
+    if (o->nincr != active->nincr) {
+        ad5933_set_nincr(dev, o->nincr);
+        n++;
+    }
+    if (o->fincr != active->fincr) {
+        ad5933_set_fincr_hz(dev, o->fincr);
+        n++;
+    }
+    if (o->tsettle != active->tsettle || o->xtsettle != active->xtsettle) {
+        ad5933_set_tsettle(dev, o->tsettle, o->xtsettle);
+        n++;
     }
+    if (o->nrange != active->nrange) {
+        ad5933_set_output_range(dev, o->nrange);
+        n++;
+    }
+    if (o->pgagain != active->pgagain) {
+        ad5933_set_pga_gain(dev, o->pgagain);
+        n++;
+    }
+    return n;
+}
+
+/*  Reprogram only those registers where o differs from the active options.
+ *  Returns the number of register writes. */
+uint8_t update_ad5933(SweepOptions *active, SweepOptions *o)
+{
+    uint8_t i, n = 0;
+
+    for (i = 0; i < BOARD_NDEVICES; i++)
+        n += update_device(&ad5933_devices[i], active, o);
+    *active = *o;
+    return n;
+}
+
+void print_options(FILE *stream, SweepOptions *o)
+{
+    fprintf_P(stream, PSTR("-fstart   = %.2lf\n"), o->fstart);
+    fprintf_P(stream, PSTR("-fincr    = %.2lf\n"), o->fincr);
+    fprintf_P(stream, PSTR("-nincr    = %u\n"), o->nincr);
+    fprintf_P(stream, PSTR("-tsettle  = %u\n"), o->tsettle);
+    fprintf_P(stream, PSTR("-xtsettle = %hhu\n"), o->xtsettle);
+    fprintf_P(stream, PSTR("-nrange   = %hhu\n"), o->nrange);
+    fprintf_P(stream, PSTR("-pgagain  = %S\n"), o->pgagain ? PSTR("true") : PSTR("false"));
+    fprintf_P(stream, PSTR("-average  = %hhu\n"), o->average);
+}
+
+/*  Sweep options accepted by 'p'. They may be given positionally in this
+ *  order, as key=value pairs or mixed. */
+static const cmd_option_t options[] PROGMEM = {
+    {"fstart",   offsetof(SweepOptions, fstart),   CMD_FIX2, 0, 10000000},
+    {"fincr",    offsetof(SweepOptions, fincr),    CMD_FIX2, 0, 10000000},
+    {"nincr",    offsetof(SweepOptions, nincr),    CMD_U16,  0, 511},
+    {"tsettle",  offsetof(SweepOptions, tsettle),  CMD_U16,  0, 511},
+    {"xtsettle", offsetof(SweepOptions, xtsettle), CMD_U8,   1, 4},
+    {"nrange",   offsetof(SweepOptions, nrange),   CMD_U8,   1, 4},
+    {"pgagain",  offsetof(SweepOptions, pgagain),  CMD_U8,   0, 1},
+    {"average",  offsetof(SweepOptions, average),  CMD_U8,   1, 255},
+};
+
+/*  Parse options into o. Nothing is changed unless all of them are valid. */
+int set_options(SweepOptions *o, uint8_t argc, char **argv)
+{
+    SweepOptions tmp = *o;
+    int rv;
+
+    rv = cmd_parse_options(options, sizeof(options) / sizeof(options[0]),
+        &tmp, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+    if (tmp.xtsettle == 3)
+        return CMD_ERR_RANGE;
+
+    *o = tmp;
+    return CMD_OK;
+}
+
+/*  Arguments of 's': number of sweeps (0 = until aborted), the interval
+ *  between sweep starts in milliseconds (0 = back-to-back), the delta
+ *  keyframe interval in sweeps (0 = text output), whether to print only
+ *  the statistics of all sweeps, and the increments, number and kind of
+ *  the dense sub-sweeps of an adaptive zoom sweep (0 = linear sweep) */
+typedef struct {
+    uint16_t count;
+    uint32_t interval;
+    uint16_t delta;
+    uint8_t stats;
+    uint8_t zoom;
+    uint8_t regions;
+    uint8_t by;
+    uint8_t scan;
+    uint16_t temp;
+    int16_t drift;
+    double tref;
+    uint16_t ref;
+} SweepArgs;
+
+/*  Temperature arguments shared by 's' and 'f': readings every temp sweeps
+ *  or seconds, gain drift in ppm per C and its reference temperature in C,
+ *  which defaults to the first reading */
+#define TREF_FIRST -1000.0
+#define TEMP_ARGS(type) \
+    {"temp",  offsetof(type, temp),  CMD_U16,  0, 3600}, \
+    {"drift", offsetof(type, drift), CMD_S16,  -10000, 10000}, \
+    {"tref",  offsetof(type, tref),  CMD_FIX2, -4000, 15000}
+
+static int16_t temp_ref(double tref)
+{
+    if (tref == TREF_FIRST)
+        return TEMP_REF_FIRST;
+    return tref * 100 + (tref < 0 ? -0.5 : 0.5);
+}
+
+static const cmd_option_t sweep_args[] PROGMEM = {
+    {"count",    offsetof(SweepArgs, count),    CMD_U16, 0, 65535},
+    {"interval", offsetof(SweepArgs, interval), CMD_U32, 0, 3600000},
+    {"delta",    offsetof(SweepArgs, delta),    CMD_U16, 0, 65535},
+    {"stats",    offsetof(SweepArgs, stats),    CMD_U8,  0, 1},
+    {"zoom",     offsetof(SweepArgs, zoom),     CMD_U8,  0, ZOOM_MAX_DENSE - 1},
+    {"regions",  offsetof(SweepArgs, regions),  CMD_U8,  1, ZOOM_MAX_REGIONS},
+    {"by",       offsetof(SweepArgs, by),       CMD_U8,  ZOOM_REACTANCE, ZOOM_PHASE},
+    {"scan",     offsetof(SweepArgs, scan),     CMD_U8,  0, 1},
+    TEMP_ARGS(SweepArgs),
+    {"ref",      offsetof(SweepArgs, ref),      CMD_U16, 0, 65535},
+};
 
-    *rdata = (double) rdata_raw / avg;
-    *idata = (double) idata_raw / avg;
+int start_sweep(Settings *cfg, uint8_t argc, char **argv)
+{
+    SweepArgs args = {
+        .count = 1,
+        .regions = 1,
+        .tref = TREF_FIRST
+    };
+    AcqParams p = {
+        .mode = ACQ_SWEEP
+    };
+    uint8_t order[SCAN_MAX_CHANNELS];
+    int rv;
+
+    rv = cmd_parse_options(sweep_args, sizeof(sweep_args) / sizeof(sweep_args[0]),
+        &args, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+    if (args.delta && cfg->opts.nincr + 1 > DELTA_MAX_POINTS)
+        return CMD_ERR_RANGE;
+    if (args.stats && args.delta)
+        return CMD_ERR_ARGS;
+    if (args.stats && cfg->opts.nincr + 1 > STATS_MAX_POINTS)
+        return CMD_ERR_RANGE;
+    if (args.zoom && (args.count != 1 || args.delta || args.stats))
+        return CMD_ERR_ARGS;
+    if (args.zoom && (cfg->opts.fincr == 0 || cfg->opts.nincr == 0))
+        return CMD_ERR_RANGE;
+    if (args.scan && (args.delta || args.stats || args.zoom))
+        return CMD_ERR_ARGS;
+    if (args.scan && scan_order(order) == 0)
+        return CMD_ERR_ARGS;
+    if (args.drift && !args.temp)
+        return CMD_ERR_ARGS;
+    if (args.ref && (args.scan || args.zoom))
+        return CMD_ERR_ARGS;
+    if (args.zoom && (args.zoom < 2 || cfg->opts.nincr < 2
+            || cfg->opts.nincr + 1 > ZOOM_MAX_POINTS))
+        return CMD_ERR_RANGE;
+
+    p.count = args.count;
+    p.interval = args.interval * CLOCK_TICKS_PER_MS;
+    p.delta = args.delta != 0;
+    p.keyint = args.delta;
+    p.stats = args.stats;
+    p.zoom = args.zoom;
+    p.regions = args.regions;
+    p.feature = args.by;
+    p.scan = args.scan;
+    p.temp = args.temp;
+    p.drift = args.drift;
+    p.tref = temp_ref(args.tref);
+    p.ref = args.ref;
+    acq_start(stdout, &p, &cfg->opts);
+    return CMD_OK;
 }
 
-void sweep(FILE *stream, uint8_t average)
+/*  Arguments of 'f': up to ACQ_MAX_FREQS frequencies for a round-robin
+ *  freerun and the settling cycles after each hop */
+typedef struct {
+    double freq[ACQ_MAX_FREQS];
+    uint16_t settle;
+    uint16_t rate;
+    uint8_t cic;
+    uint8_t decim;
+    double lp;
+    uint16_t db;
+    uint16_t lo;
+    uint16_t hi;
+    uint16_t hb;
+    uint8_t dev;
+    uint16_t temp;
+    int16_t drift;
+    double tref;
+    uint16_t ref;
+} FreerunArgs;
+
+static const cmd_option_t freerun_args[] PROGMEM = {
+    {"f1",     offsetof(FreerunArgs, freq[0]), CMD_FIX2, 100, 10000000},
+    {"f2",     offsetof(FreerunArgs, freq[1]), CMD_FIX2, 100, 10000000},
+    {"f3",     offsetof(FreerunArgs, freq[2]), CMD_FIX2, 100, 10000000},
+    {"f4",     offsetof(FreerunArgs, freq[3]), CMD_FIX2, 100, 10000000},
+    {"settle", offsetof(FreerunArgs, settle),  CMD_U16,  0, 511},
+    {"rate",   offsetof(FreerunArgs, rate),    CMD_U16,  0, 1000},
+    {"cic",    offsetof(FreerunArgs, cic),     CMD_U8,   0, FILTER_MAX_ORDER},
+    {"decim",  offsetof(FreerunArgs, decim),   CMD_U8,   1, FILTER_MAX_DECIM},
+    {"lp",     offsetof(FreerunArgs, lp),      CMD_FIX2, 0, 50000},
+    {"db",     offsetof(FreerunArgs, db),      CMD_U16,  0, 65535},
+    {"lo",     offsetof(FreerunArgs, lo),      CMD_U16,  0, 65535},
+    {"hi",     offsetof(FreerunArgs, hi),      CMD_U16,  0, 65535},
+    {"hb",     offsetof(FreerunArgs, hb),      CMD_U16,  0, 3600},
+    {"dev",    offsetof(FreerunArgs, dev),     CMD_U8,   1,
+        BOARD_NDEVICES < ACQ_MAX_DEVICES ? BOARD_NDEVICES : ACQ_MAX_DEVICES},
+    TEMP_ARGS(FreerunArgs),
+    {"ref",    offsetof(FreerunArgs, ref),     CMD_U16,  0, 3600},
+};
+
+int start_freerun(Settings *cfg, uint8_t argc, char **argv)
 {
-    double rdata, idata;
+    FreerunArgs args = {
+        .settle = cfg->opts.tsettle,
+        .decim = 1,
+        .dev = 1,
+        .tref = TREF_FIRST
+    };
+    AcqParams p = {
+        .mode = ACQ_FREERUN
+    };
+    uint8_t i;
+    int rv;
+
+    rv = cmd_parse_options(freerun_args, sizeof(freerun_args) / sizeof(freerun_args[0]),
+        &args, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+
+    /*  Frequency codes are computed once here, so hopping needs no float math */
+    for (i = 0; i < ACQ_MAX_FREQS; i++)
+        if (args.freq[i] != 0)
+            p.fcode[p.nfreqs++] = ad5933_freq_code(args.freq[i]);
+    p.settle = args.settle;
+    p.rate = args.rate;
+    p.devices = args.dev;
+    if (p.devices > 1 && (p.nfreqs || p.rate || args.temp))
+        return CMD_ERR_ARGS;
+    if (args.drift && !args.temp)
+        return CMD_ERR_ARGS;
+    if (args.ref && (p.nfreqs || p.devices > 1))
+        return CMD_ERR_ARGS;
+    p.temp = args.temp;
+    p.drift = args.drift;
+    p.tref = temp_ref(args.tref);
+    p.ref = args.ref;
+    p.drop = cfg->link.drop;
+
+    /*  Decimation alone means moving average. The low-pass cutoff is given
+     *  in Hz, so it needs the paced sample rate, which is shared by all
+     *  frequencies of a round-robin. */
+    if (args.decim > 1 && args.cic == 0)
+        args.cic = 1;
+    if (args.lp > 0 && args.rate == 0)
+        return CMD_ERR_ARGS;
+    if (filter_init(args.cic, args.decim, args.rate ?
+            args.lp * args.decim * (p.nfreqs ? p.nfreqs : 1) / args.rate : 0) == -1)
+        return CMD_ERR_RANGE;
+    event_init(args.db, args.lo, args.hi, (uint32_t) args.hb * CLOCK_HZ);
+
+    acq_start(stdout, &p, &cfg->opts);
+    return CMD_OK;
+}
+
+/*  Arguments of 'a': what to run on each trigger, the samples of a burst,
+ *  the INT0 edge and the number of triggers (0 = until aborted) */
+#define ARM_SWEEP 0
+#define ARM_BURST 1
+#define ARM_POINT 2
+
+typedef struct {
+    uint8_t run;
+    uint16_t n;
+    uint8_t edge;
+    uint16_t count;
+} ArmArgs;
 
-    ad5933_init_with_fstart();
-    ad5933_start_sweep();
+static const cmd_option_t arm_args[] PROGMEM = {
+    {"run",   offsetof(ArmArgs, run),   CMD_U8,  ARM_SWEEP, ARM_POINT},
+    {"n",     offsetof(ArmArgs, n),     CMD_U16, 1, 65535},
+    {"edge",  offsetof(ArmArgs, edge),  CMD_U8,  INT0_ANY, INT0_RISING},
+    {"count", offsetof(ArmArgs, count), CMD_U16, 0, 65535},
+};
 
-    take_measurement(average, &rdata, &idata);
-    fprintf(stream, "%.4f %.4f\n", rdata, idata);
-    ad5933_increment_sweep();
+int arm_trigger(Settings *cfg, uint8_t argc, char **argv)
+{
+    ArmArgs args = {
+        .n = 1,
+        .edge = INT0_RISING,
+        .count = 1
+    };
+    AcqParams p = { 0 };
+    int rv;
 
-    while (!ad5933_sweep_complete()) {
-        take_measurement(average, &rdata, &idata);
-        fprintf(stream, "%.4f %.4f\n", rdata, idata);
-        ad5933_increment_sweep();
+    rv = cmd_parse_options(arm_args, sizeof(arm_args) / sizeof(arm_args[0]),
+        &args, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+
+    p.trigger = args.edge;
+    p.count = args.count;
+    p.drop = cfg->link.drop;
+    switch (args.run) {
+        case ARM_SWEEP:
+            p.mode = ACQ_SWEEP;
+            break;
+        case ARM_BURST:
+            p.mode = ACQ_FREERUN;
+            p.samples = args.n;
+            break;
+        case ARM_POINT:
+            p.mode = ACQ_FREERUN;
+            p.samples = 1;
+            p.average = cfg->opts.average;
+            break;
     }
-    ad5933_reset();
+    filter_init(0, 1, 0);
+    event_init(0, 0, 0, 0);
+    acq_start(stdout, &p, &cfg->opts);
+    return CMD_OK;
 }
 
-void freerun(FILE *stream)
+/*  Arguments of 'm': channel, PORTB pattern, switch settling time in ms
+ *  and frequency (0 = sweep) */
+typedef struct {
+    uint8_t ch;
+    uint8_t port;
+    uint8_t settle;
+    double freq;
+} ChannelArgs;
+
+static const cmd_option_t channel_args[] PROGMEM = {
+    {"ch",     offsetof(ChannelArgs, ch),     CMD_U8,   0, SCAN_MAX_CHANNELS - 1},
+    {"port",   offsetof(ChannelArgs, port),   CMD_U8,   0, 255},
+    {"settle", offsetof(ChannelArgs, settle), CMD_U8,   0, 255},
+    {"f",      offsetof(ChannelArgs, freq),   CMD_FIX2, 0, 10000000},
+};
+
+int set_channel(uint8_t argc, char **argv)
 {
-    ad5933_init_with_fstart();
-    ad5933_start_sweep();
+    ChannelArgs args = { 0 };
+    int rv;
 
-    while(!USART0_ESCAPE) {
-        _delay_ms(1); // The conversion process takes approximately 1 ms using a 16.777 MHz clock.
-        while (!ad5933_has_valid_impedance());
-        fprintf(stream, "%d %d\n", ad5933_get_real(), ad5933_get_imaginary());
-        ad5933_repeat_frequency();
+    if (argc == 1) {
+        scan_print(stdout);
+        return CMD_OK;
     }
-    ad5933_reset();
+    if (argc == 2 && strcmp(argv[1], "clear") == 0) {
+        scan_clear();
+        return CMD_OK;
+    }
+
+    rv = cmd_parse_options(channel_args, sizeof(channel_args) / sizeof(channel_args[0]),
+        &args, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+    if (args.freq != 0 && args.freq < 100)
+        return CMD_ERR_RANGE;
+    scan_set(args.ch, args.port, args.settle,
+        args.freq != 0 ? ad5933_freq_code(args.freq) : 0);
+    return CMD_OK;
 }
 
-void print_options(FILE *stream, SweepOptions *o)
+void print_profiles(FILE *stream)
+{
+    Profile p;
+    uint8_t n;
+
+    for (n = 0; n < SETTINGS_NPROFILES; n++)
+        if (settings_load_profile(n, &p) == 0)
+            fprintf_P(stream, PSTR("%hhu %-7s %.2lf %.2lf %u %hhu\n"), n, p.name,
+                p.opts.fstart, p.opts.fincr, p.opts.nincr, p.opts.average);
+        else
+            fprintf_P(stream, PSTR("%hhu -\n"), n);
+}
+
+/*  Switch to the named (or numbered) profile and report the time it took */
+int use_profile(FILE *stream, Settings *s, const char *name)
+{
+    Profile p;
+    uint32_t t;
+    int32_t slot;
+    uint8_t n;
+
+    if (settings_find_profile(name, &p) == -1) {
+        if (cmd_parse_int(name, 0, SETTINGS_NPROFILES - 1, &slot) != CMD_OK
+                || settings_load_profile(slot, &p) == -1)
+            return CMD_ERR_KEY;
+    }
+
+    t = clock_ticks();
+    n = update_ad5933(&s->opts, &p.opts);
+    t = clock_ticks() - t;
+    settings_save(s);
+
+    fprintf_P(stream, PSTR("%s: %hhu writes in %lu.%lu ms\n"), p.name, n,
+        t / CLOCK_TICKS_PER_MS, t % CLOCK_TICKS_PER_MS);
+    return CMD_OK;
+}
+
+static const cmd_option_t power_args[] PROGMEM = {
+    {"sleep",   offsetof(PowerOptions, sleep),   CMD_U8,  0, 1},
+    {"pwrdown", offsetof(PowerOptions, pwrdown), CMD_U8,  0, 1},
+    {"warmup",  offsetof(PowerOptions, warmup),  CMD_U16, 0, 10000},
+};
+
+int set_power(Settings *cfg, uint8_t argc, char **argv)
+{
+    PowerOptions tmp = cfg->power;
+    int rv;
+
+    rv = cmd_parse_options(power_args, sizeof(power_args) / sizeof(power_args[0]),
+        &tmp, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+    cfg->power = tmp;
+    power_set(&cfg->power);
+    settings_save(cfg);
+    return CMD_OK;
+}
+
+static const cmd_option_t link_args[] PROGMEM = {
+    {"flow", offsetof(LinkOptions, flow), CMD_U8, USART0_FLOW_NONE, USART0_FLOW_RTSCTS},
+    {"drop", offsetof(LinkOptions, drop), CMD_U8, 0, 1},
+};
+
+int set_link(Settings *cfg, uint8_t argc, char **argv)
+{
+    LinkOptions tmp = cfg->link;
+    int rv;
+
+    rv = cmd_parse_options(link_args, sizeof(link_args) / sizeof(link_args[0]),
+        &tmp, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+    cfg->link = tmp;
+    usart0_set_flow(cfg->link.flow);
+    settings_save(cfg);
+    return CMD_OK;
+}
+
+void print_info(FILE *stream, Settings *s)
+{
+    uint32_t t = acq_first_sample_ticks();
+
+    fprintf_P(stream, PSTR("-boot     = %hhu\n"), s->boot);
+    fprintf_P(stream, PSTR("-devices  = %u\n"), BOARD_NDEVICES);
+    fprintf_P(stream, PSTR("-sleep    = %hhu\n"), s->power.sleep);
+    fprintf_P(stream, PSTR("-pwrdown  = %hhu\n"), s->power.pwrdown);
+    fprintf_P(stream, PSTR("-warmup   = %u ms\n"), s->power.warmup);
+    fprintf_P(stream, PSTR("-flow     = %hhu\n"), s->link.flow);
+    fprintf_P(stream, PSTR("-drop     = %hhu\n"), s->link.drop);
+    if (t)
+        fprintf_P(stream, PSTR("-tfirst   = %lu.%lu ms\n"),
+            t / CLOCK_TICKS_PER_MS, t % CLOCK_TICKS_PER_MS);
+    else
+        fprintf_P(stream, PSTR("-tfirst   = none\n"));
+}
+
+void print_memory(FILE *stream)
+{
+    fprintf_P(stream, PSTR("-static   = %u\n"), mem_static());
+    fprintf_P(stream, PSTR("-stack    = %u\n"), mem_stack_max());
+    fprintf_P(stream, PSTR("-free     = %u\n"), mem_free_min());
+}
+
+/*  Arguments of 'e': the output format, see plan.h, and a sweep time in
+ *  milliseconds to fit the average and the number of increments into */
+typedef struct {
+    uint8_t format;
+    uint32_t ms;
+} PlanArgs;
+
+static const cmd_option_t plan_args[] PROGMEM = {
+    {"fmt", offsetof(PlanArgs, format), CMD_U8,  PLAN_TEXT, PLAN_STATS},
+    {"ms",  offsetof(PlanArgs, ms),     CMD_U32, 0, 3600000},
+};
+
+/*  What limits the rate: the output, the bus or the AD5933 itself */
+static const char *plan_bound(const PlanTimes *t)
 {
-    fprintf(stream, "-fstart   = %.2lf\n", o->fstart);
-    fprintf(stream, "-fincr    = %.2lf\n", o->fincr);
-    fprintf(stream, "-nincr    = %u\n", o->nincr);
-    fprintf(stream, "-tsettle  = %u\n", o->tsettle);
-    fprintf(stream, "-xtsettle = %hhu\n", o->xtsettle);
-    fprintf(stream, "-nrange   = %hhu\n", o->nrange);
-    fprintf(stream, "-pgagain  = %s\n", o->pgagain ? "true" : "false");
-    fprintf(stream, "-average  = %hhu\n", o->average);
+    if (t->link >= t->acquire)
+        return PSTR("link");
+    return t->bus >= t->settle + t->convert ? PSTR("bus") : PSTR("AD5933");
+}
+
+int print_plan(Settings *cfg, uint8_t argc, char **argv)
+{
+    PlanArgs args = {PLAN_TEXT, 0};
+    PlanTimes t;
+    int16_t n;
+    int rv;
+
+    rv = cmd_parse_options(plan_args, sizeof(plan_args) / sizeof(plan_args[0]),
+        &args, argc, argv);
+    if (rv != CMD_OK)
+        return rv;
+
+    plan_sweep(&cfg->opts, args.format, &t);
+    printf_P(PSTR("-settle   = %.1f ms\n"), t.settle);
+    printf_P(PSTR("-convert  = %.1f ms\n"), t.convert);
+    printf_P(PSTR("-bus      = %.1f ms\n"), t.bus);
+    printf_P(PSTR("-link     = %.1f ms\n"), t.link);
+    printf_P(PSTR("-sweep    = %.1f ms, %S bound\n"), t.total, plan_bound(&t));
+    plan_freerun(&cfg->opts, &t);
+    printf_P(PSTR("-freerun  = %.1f Hz, %S bound\n"), 1000 / t.total, plan_bound(&t));
+
+    if (args.ms) {
+        if ((n = plan_max_average(&cfg->opts, args.format, args.ms)) < 0)
+            printf_P(PSTR("-average  = none\n"));
+        else
+            printf_P(PSTR("-average  = %d\n"), n);
+        if ((n = plan_max_nincr(&cfg->opts, args.format, args.ms)) < 0)
+            printf_P(PSTR("-nincr    = none\n"));
+        else
+            printf_P(PSTR("-nincr    = %d\n"), n);
+    }
+    return CMD_OK;
 }
 
 #define VERSION "v0.2"
 
+void print_progress(FILE *stream)
+{
+    switch (acq_mode()) {
+        case ACQ_SWEEP:
+            fprintf_P(stream, PSTR("# sweep %u point %u/%u\n"), acq_sweeps_done(),
+                acq_points_done(), acq_points_total());
+            break;
+        case ACQ_FREERUN:
+            fprintf_P(stream, PSTR("# freerun\n"));
+            break;
+        default:
+            fprintf_P(stream, PSTR("# idle\n"));
+            break;
+    }
+}
+
+void print_help(FILE *stream)
+{
+    fprintf_P(stream, PSTR(
+        "OpenEBI " VERSION "\n"
+        "Copyright (c) 2012-2013 Kim H Blomqvist\n"
+        "Developed at the Department of Electronics at Aalto University.\n\n"
+        "s\tSweep: count interval delta stats zoom regions by scan temp ref\n"
+        "p\tSet sweep options: p <key>=<value>...\n"
+        "f\tFreerun: f [f1..f4] settle rate decim cic lp db lo hi hb dev temp ref\n"
+        "a\tTriggered run on INT0: a run n edge count\n"
+        "m\tScan table: m [<ch> <port> settle f | clear]\n"
+        "q\tProgress of the running sweep\n"
+        "e\tPredict sweep time: e fmt ms\n"
+        "x\tAbort\n"
+        "o\tPrint options\n"
+        "w\tStore profile: w <slot> <name>\n"
+        "u\tUse profile: u <name|slot>\n"
+        "l\tList profiles\n"
+        "b\tBoot mode: b <0-3>\n"
+        "i\tBoot, power and link info\n"
+        "r\tRAM and stack use\n"
+#ifdef TWI_TRACE
+        "d\tDump TWI trace\n"
+#endif
+        "z\tPower: z sleep pwrdown warmup\n"
+        "c\tLink: c flow drop\n"
+        // "t\tRuns unit tests.\n"
+        "h\tThis help, see README.md for details\n\n"
+        "';' separates commands. ERROR 1 = command, 2 = arguments,\n"
+        "3 = key or name, 4 = value, 5 = range, 6 = line.\n"
+    ));
+}
+
+/*  Start measuring right away in a boot mode that asks for it. The
+ *  parameters are built on the stack, a const struct would sit in RAM. */
+static void boot_start(Settings *cfg)
+{
+    AcqParams p = {
+        .mode = cfg->boot == BOOT_SWEEP ? ACQ_SWEEP : ACQ_FREERUN,
+        .count = cfg->boot == BOOT_SWEEP ? 1 : 0,
+        .drop = cfg->link.drop
+    };
+
+    acq_start(stdout, &p, &cfg->opts);
+}
+
+/*  Commands that reprogram the AD5933 have to wait until it is idle */
+static bool needs_ad5933(char c)
+{
+    return c == 's' || c == 'f' || c == 'p' || c == 'u' || c == 'a';
+}
+
+/*  A running scan reads its table channel by channel */
+static bool needs_idle(char c)
+{
+    return needs_ad5933(c) || c == 'm';
+}
+
+int run_command(Settings *cfg, char *cmd)
+{
+    char *argv[CMD_MAX_ARGS];
+    Profile profile;
+    int32_t v;
+    int argc, rv;
+
+    if ((argc = cmd_tokenize(cmd, argv, CMD_MAX_ARGS)) == -1)
+        return CMD_ERR_ARGS;
+    if (argc == 0)
+        return CMD_OK;
+
+    switch (argv[0][0]) {
+        case 's':
+            return start_sweep(cfg, argc, argv);
+        case 'p':
+            if ((rv = set_options(&cfg->opts, argc, argv)) != CMD_OK)
+                return rv;
+            init_ad5933(&cfg->opts);
+            settings_save(cfg);
+            break;
+        case 'b':
+            if (argc != 2)
+                return CMD_ERR_ARGS;
+            if ((rv = cmd_parse_int(argv[1], BOOT_NORMAL, BOOT_FREERUN, &v)) != CMD_OK)
+                return rv;
+            cfg->boot = v;
+            settings_save(cfg);
+            break;
+        case 'w':
+            if (argc != 3)
+                return CMD_ERR_ARGS;
+            if ((rv = cmd_parse_int(argv[1], 0, SETTINGS_NPROFILES - 1, &v)) != CMD_OK)
+                return rv;
+            if (strlen(argv[2]) >= PROFILE_NAME_LEN)
+                return CMD_ERR_RANGE;
+            memset(&profile, 0, sizeof(profile));
+            strcpy(profile.name, argv[2]);
+            profile.opts = cfg->opts;
+            settings_save_profile(v, &profile);
+            break;
+        case 'u':
+            if (argc != 2)
+                return CMD_ERR_ARGS;
+            return use_profile(stdout, cfg, argv[1]);
+        case 'l':
+            print_profiles(stdout);
+            break;
+        case 'f':
+            return start_freerun(cfg, argc, argv);
+        case 'a':
+            return arm_trigger(cfg, argc, argv);
+        case 'm':
+            return set_channel(argc, argv);
+        case 'q':
+            print_progress(stdout);
+            break;
+        case 'x':
+            acq_abort();
+            break;
+        case 'o':
+            print_options(stdout, &cfg->opts);
+            break;
+        case 'i':
+            print_info(stdout, cfg);
+            break;
+        case 'z':
+            return set_power(cfg, argc, argv);
+        case 'c':
+            return set_link(cfg, argc, argv);
+        case 'r':
+            print_memory(stdout);
+            break;
+        case 'e':
+            return print_plan(cfg, argc, argv);
+#ifdef TWI_TRACE
+        case 'd':
+            twi_trace_dump(stdout);
+            break;
+#endif
+        // case 't':
+        //     run_tests();
+        //     break;
+        case 'h':
+            print_help(stdout);
+            break;
+        default:
+            printf_P(PSTR("Command 'h' for help\n"));
+            return CMD_ERR_UNKNOWN;
+    }
+    return CMD_OK;
+}
+
 int main(void)
 {
-    SweepOptions opts = {
-        .fstart = 4000,
-        .fincr = 2000,
-        .nincr = 48,
-        .tsettle = 10,
-        .xtsettle = 1,
-        .nrange = 1,
-        .pgagain = true,
-        .average = 16
+    Settings cfg = {
+        .opts = {
+            .fstart = 4000,
+            .fincr = 2000,
+            .nincr = 48,
+            .tsettle = 10,
+            .xtsettle = 1,
+            .nrange = 1,
+            .pgagain = true,
+            .average = 16
+        },
+        .boot = BOOT_NORMAL,
+        .power = {
+            .sleep = false,
+            .pwrdown = false,
+            .warmup = 10
+        },
+        .link = {
+            .flow = USART0_FLOW_NONE,
+            .drop = false
+        }
     };
 
-    char cmdbuf[64] = {};
+    CmdLine cmdline = {};
+    char *batch = NULL, *cmd = NULL;
+    bool prompt = true;
+    int rv;
 
     init_board();
-    init_ad5933(&opts);
+    settings_load(&cfg);
+    init_ad5933(&cfg.opts);
+    power_init(&cfg.power);
+    usart0_set_flow(cfg.link.flow);
 
-    _delay_ms(1000);
-    printf("\rOpenEBI " VERSION "\n");
-    printf("Copyright (c) 2012-2013 Kim H Blomqvist\n");
-    printf("Developed at the Department of Electronics at Aalto University.\n\n");
-    print_options(stdout, &opts);
-    printf("\nWhile in PuTTY use ^J instead of ENTER\n\n");
+    switch (cfg.boot) {
+        case BOOT_SWEEP:
+        case BOOT_FREERUN:
+            boot_start(&cfg);
+            break;
+        case BOOT_QUIET:
+            break;
+        default:
+            _delay_ms(1000);
+            printf_P(PSTR("\rOpenEBI " VERSION "\n"));
+            printf_P(PSTR("Copyright (c) 2012-2013 Kim H Blomqvist\n"));
+            printf_P(PSTR("Developed at the Department of Electronics at "
+                "Aalto University.\n\n"));
+            print_options(stdout, &cfg.opts);
+            printf_P(PSTR("\n"));
+            break;
+    }
 
-    /*  Main loop */
+    /*  Main loop. Every task returns as soon as it has nothing to do, so the
+     *  console stays responsive while a sweep is running. */
     for (;;) {
-        printf("$ ");
-        if (fgets(cmdbuf, sizeof(cmdbuf), stdin) == NULL) {
-            printf("ERROR!\n");
+        acq_task();
+
+        /*  ESC aborts the acquisition and drops any queued commands */
+        if (USART0_ESCAPE) {
+            acq_abort();
+            batch = cmd = NULL;
+            prompt = true;
+        }
+
+        if (batch == NULL) {
+            if (prompt && !acq_busy()) {
+                printf_P(PSTR("$ "));
+                prompt = false;
+            }
+            if (!USART0_DATARECEIVED) {
+                power_idle();
+                continue;
+            }
+            switch (cmd_feed(&cmdline, getchar())) {
+                case 1:
+                    batch = cmdline.buf;
+                    break;
+                case -1:
+                    printf_P(PSTR("ERROR %d\n"), CMD_ERR_LINE);
+                    prompt = true;
+                    break;
+            }
             continue;
         }
 
-        switch (cmdbuf[0]) {
-            case 's':
-                sweep(stdout, opts.average);
-                break;
-            case 'p':
-                sscanf(&cmdbuf[1], "%lf %lf %u %u %hhu %hhu %hhu %hhu", &opts.fstart, &opts.fincr,
-                    &opts.nincr, &opts.tsettle, &opts.xtsettle, &opts.nrange, &opts.pgagain, &opts.average);
-                if (opts.tsettle > 511)
-                    opts.tsettle = 511;
-                if (opts.xtsettle != 1 && opts.xtsettle != 2 && opts.xtsettle != 4)
-                    opts.xtsettle = 1;
-                init_ad5933(&opts);
-                break;
-            case 'f':
-                freerun(stdout);
-                break;
-            case 'o':
-                print_options(stdout, &opts);
-                break;
-            // case 't':
-            //     run_tests();
-            //     break;
-            case 'h':
-                printf(
-                    "OpenEBI " VERSION "\n"
-                    "Copyright (c) 2012-2013 Kim H Blomqvist\n"
-                    "Developed at the Department of Electronics at Aalto University.\n\n"
-                    "s\tRuns a frequency sweep. Output is in \"R I\" format.\n"
-                    "p\tSets sweep options. The argument order is as in options struct.\n"
-                    "f\tFreerun using the programmed start frequency. Abort with ESC.\n"
-                    "o\tPrints the current options.\n"
-                    // "t\tRuns unit tests.\n"
-                    "h\tShows this help.\n"
-                );
-                break;
-            default:
-                printf("Command 'h' for help\n");
-                break;
+        /*  Run a batch of commands, stop at the first failing one */
+        if (cmd == NULL && (cmd = cmd_next(&batch)) == NULL) {
+            prompt = true;
+            continue;
+        }
+        if (needs_idle(*cmd) && acq_busy()) {
+            power_idle();
+            continue; // queued until the acquisition finishes
+        }
+        if (needs_ad5933(*cmd) && !power_ready()) {
+            power_wake();
+            power_idle();
+            continue; // queued until the AD5933 has warmed up
+        }
+        if ((rv = run_command(&cfg, cmd)) != CMD_OK) {
+            printf_P(PSTR("ERROR %d\n"), rv);
+            batch = NULL;
+            prompt = true;
         }
+        cmd = NULL;
     }
 }
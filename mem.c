@@ -0,0 +1,73 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/io.h>
+#include <inttypes.h>
+#include "mem.h"
+
+/*  Provided by the linker script */
+extern uint8_t __data_start;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/*  Runs before the stack pointer and the zero register are set up, hence
+ *  no C code and no stack here */
+void mem_paint(void) __attribute__((naked, used, section(".init1")));
+
+void mem_paint(void)
+{
+    __asm volatile (
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n"
+        :: "M" (MEM_PAINT));
+}
+
+uint16_t mem_static(void)
+{
+    return &_end - &__data_start;
+}
+
+uint16_t mem_free_min(void)
+{
+    const uint8_t *p = &_end;
+
+    while (p <= &__stack && *p == MEM_PAINT)
+        p++;
+    return p - &_end;
+}
+
+uint16_t mem_stack_max(void)
+{
+    return &__stack - &_end + 1 - mem_free_min();
+}
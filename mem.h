@@ -0,0 +1,47 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __MEM_H
+#define __MEM_H
+
+#include <inttypes.h>
+
+/*  SRAM usage. Everything between the end of the static data and the top
+ *  of the stack is painted with MEM_PAINT before main() runs, so the
+ *  deepest the stack has reached since reset can be told afterwards.
+ *  There is no heap, so nothing else grows into that space. */
+#define MEM_PAINT 0xc5
+
+/*  Bytes of initialized and zeroed static data */
+uint16_t mem_static(void);
+
+/*  Most bytes the stack has used since reset */
+uint16_t mem_stack_max(void);
+
+/*  Fewest bytes that have been free between static data and stack */
+uint16_t mem_free_min(void);
+
+#endif
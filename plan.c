@@ -0,0 +1,141 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+#include "ad5933.h"
+#include "board.h"
+#include "plan.h"
+
+/*  DFT of 1024 samples at MCLK / 16 */
+#define DFT_MS (1024 * 16 * 1000.0 / AD5933_CLOCK_HZ)
+
+/*  acq_task() polls the status CONVERSION_TICKS after a start */
+#define FIRST_POLL_MS 1.0
+
+/*  Bus time of the driver calls of acq_task() in bit times, 9 per byte and
+ *  one per start or stop condition, see ad5933.c */
+#define POLL_BITS    (5 * 9 + 3)        // ad5933_rbyte() of the status
+#define READ_BITS    (2 * (9 * 9 + 5))  // ad5933_get_real() and _imaginary()
+#define RESTART_BITS (3 * 9 + 2)        // ad5933_wbyte() of the control
+#define BIT_MS (1000.0 / BOARD_TWI_HZ)
+
+#define CHAR_MS (10 * 1000.0 / BOARD_BAUD) // 8N1
+
+/*  Typical characters sent per point and per sweep header by format, e.g.
+ *  "1234.5000 -567.2500\n" for text */
+static const uint8_t point_chars[] PROGMEM = {20, 4, 0};
+static const uint8_t sweep_chars[] PROGMEM = {12, 16, 0};
+
+/*  Freerun "R I\n" */
+#define FREERUN_CHARS 10
+
+/*  Add average conversions at f Hz. The first poll of each finds the
+ *  conversion done unless settling takes longer than the 1 ms wait, then
+ *  polls follow back to back until it is. */
+static void conversions(PlanTimes *t, double f, uint16_t cycles, uint8_t average)
+{
+    double settle = cycles * 1000.0 / (f < 1 ? 1 : f);
+    double polls = ceil((settle + DFT_MS - FIRST_POLL_MS) / (POLL_BITS * BIT_MS));
+
+    if (polls < 1)
+        polls = 1;
+    t->settle += average * settle;
+    t->convert += average * DFT_MS;
+    t->bus += average * (polls * POLL_BITS + READ_BITS + RESTART_BITS) * BIT_MS;
+    t->acquire += average * (FIRST_POLL_MS
+        + (polls * POLL_BITS + READ_BITS + RESTART_BITS) * BIT_MS);
+}
+
+/*  Walk the points of a sweep while it takes at most ms. Returns the number
+ *  of points that fit. */
+static uint16_t walk(const SweepOptions *o, uint8_t format, uint8_t average, double ms,
+    PlanTimes *t)
+{
+    uint16_t cycles = o->tsettle * o->xtsettle, i;
+    double chars = pgm_read_byte(&point_chars[format]) * CHAR_MS;
+    PlanTimes next;
+
+    memset(t, 0, sizeof(*t));
+    t->bus = t->acquire = 2 * RESTART_BITS * BIT_MS; // init and start
+    t->link = pgm_read_byte(&sweep_chars[format]) * CHAR_MS;
+
+    for (i = 0; i <= o->nincr; i++) {
+        next = *t;
+        conversions(&next, o->fstart + i * o->fincr, cycles, average);
+        next.bus += POLL_BITS * BIT_MS; // ad5933_sweep_complete()
+        next.acquire += POLL_BITS * BIT_MS;
+        next.link += chars;
+        /*  Only the last point's output is left once the acquisition ends */
+        next.total = (next.acquire > next.link - chars ? next.acquire : next.link - chars)
+            + chars;
+        if (next.total > ms)
+            break;
+        *t = next;
+    }
+    return i;
+}
+
+void plan_sweep(const SweepOptions *o, uint8_t format, PlanTimes *t)
+{
+    walk(o, format, o->average, INFINITY, t);
+}
+
+void plan_freerun(const SweepOptions *o, PlanTimes *t)
+{
+    memset(t, 0, sizeof(*t));
+    conversions(t, o->fstart, o->tsettle * o->xtsettle, 1);
+    t->link = FREERUN_CHARS * CHAR_MS;
+    t->total = t->acquire > t->link ? t->acquire : t->link;
+}
+
+/*  The acquisition is linear in the average and the output does not
+ *  depend on it, so two sweeps give the answer */
+int16_t plan_max_average(const SweepOptions *o, uint8_t format, double ms)
+{
+    double chars = pgm_read_byte(&point_chars[format]) * CHAR_MS, per, n;
+    PlanTimes one, two;
+
+    walk(o, format, 1, INFINITY, &one);
+    walk(o, format, 2, INFINITY, &two);
+    if (one.total > ms)
+        return -1;
+
+    per = two.acquire - one.acquire;
+    n = floor((ms - chars - (one.acquire - per)) / per);
+    return n > 255 ? 255 : n < 1 ? 1 : (int16_t) n;
+}
+
+int16_t plan_max_nincr(const SweepOptions *o, uint8_t format, double ms)
+{
+    SweepOptions all = *o;
+    PlanTimes t;
+
+    all.nincr = 511;
+    return (int16_t) walk(&all, format, o->average, ms, &t) - 1;
+}
@@ -0,0 +1,65 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __PLAN_H
+#define __PLAN_H
+
+#include <inttypes.h>
+#include "settings.h"
+
+/*  Timing model of acq_task(), for choosing sweep options without trying
+ *  them. Every conversion settles for tsettle * xtsettle cycles at its
+ *  frequency and takes a 1024 point DFT, is polled from 1 ms after its
+ *  start on back to back, read and restarted over the TWI bus, and its
+ *  output drains over the serial link while the next ones are measured.
+ *  Times are in milliseconds. */
+#define PLAN_TEXT  0
+#define PLAN_DELTA 1
+#define PLAN_STATS 2 // nothing is sent until the end of the run
+
+typedef struct PlanTimes PlanTimes;
+
+struct PlanTimes {
+    double settle;      // AD5933 settling
+    double convert;     // AD5933 DFTs
+    double bus;         // TWI transfers including status polls
+    double acquire;     // conversions, bus and waiting for both
+    double link;        // serial output
+    double total;       // elapsed, acquisition and output overlap
+};
+
+/*  One sweep with the given options and output format */
+void plan_sweep(const SweepOptions *o, uint8_t format, PlanTimes *t);
+
+/*  One freerun sample at fstart */
+void plan_freerun(const SweepOptions *o, PlanTimes *t);
+
+/*  Largest average, or nincr, for which a sweep takes at most ms. Return
+ *  -1 if not even average = 1, or nincr = 0, fits. */
+int16_t plan_max_average(const SweepOptions *o, uint8_t format, double ms);
+int16_t plan_max_nincr(const SweepOptions *o, uint8_t format, double ms);
+
+#endif
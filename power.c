@@ -0,0 +1,167 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "board.h"
+#include "clock.h"
+#include "ad5933.h"
+#include "power.h"
+
+/*  AD5933 states for the current estimate */
+#define AD_DOWN    0
+#define AD_STANDBY 1
+#define AD_ACTIVE  2
+
+static const uint16_t ad_ua[] PROGMEM = {
+    POWER_AD5933_DOWN_UA, POWER_AD5933_STANDBY_UA, POWER_AD5933_ACTIVE_UA
+};
+
+static PowerOptions opts;
+
+static struct {
+    uint8_t state;
+    uint32_t t;         // tick of the last state change
+    uint32_t time[3];   // ticks in each state since the last report
+    uint32_t woken;     // tick when the front-ends were brought up
+    uint32_t t0;        // tick of the last report
+    uint32_t run;       // tick when the run was started
+    uint32_t slept;     // ticks slept since the last report
+    uint32_t run_slept; // ... at the start of the run
+    uint8_t fine;       // clock_fine() counts slept short of a tick
+} acct;
+
+static void set_state(uint8_t state)
+{
+    uint32_t now = clock_ticks();
+
+    acct.time[acct.state] += now - acct.t;
+    acct.t = now;
+    acct.state = state;
+}
+
+void power_init(const PowerOptions *o)
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    acct.state = AD_STANDBY;
+    acct.woken = clock_ticks();
+    power_set(o);
+}
+
+void power_set(const PowerOptions *o)
+{
+    opts = *o;
+}
+
+bool power_can_idle(void)
+{
+    return opts.sleep && (SREG & _BV(SREG_I));
+}
+
+void power_idle(void)
+{
+    uint32_t t;
+    uint16_t n;
+
+    if (!power_can_idle())
+        return;
+    t = clock_fine();
+    sleep_mode();
+    n = acct.fine + (uint16_t) (clock_fine() - t);
+    acct.slept += n / CLOCK_FINE_PER_TICK;
+    acct.fine = n % CLOCK_FINE_PER_TICK;
+}
+
+void power_wake(void)
+{
+    uint8_t i;
+
+    if (acct.state != AD_DOWN)
+        return;
+    for (i = 0; i < BOARD_NDEVICES; i++)
+        ad5933_standby(&ad5933_devices[i]);
+    set_state(AD_STANDBY);
+    acct.woken = clock_ticks();
+}
+
+bool power_ready(void)
+{
+    return acct.state != AD_DOWN
+        && clock_ticks() - acct.woken >= (uint32_t) opts.warmup * CLOCK_TICKS_PER_MS;
+}
+
+void power_begin_run(void)
+{
+    set_state(AD_ACTIVE);
+    acct.run = acct.t;
+    acct.run_slept = acct.slept;
+}
+
+/*  Average current in mA over dt ticks, of which slept were spent idle */
+static double current(uint32_t dt, uint32_t slept, double ad)
+{
+    if (dt == 0)
+        return 0;
+    return (ad + (double) (dt - slept) * POWER_MCU_ACTIVE_UA
+        + (double) slept * POWER_MCU_IDLE_UA) / dt / 1000;
+}
+
+void power_end_run(FILE *stream)
+{
+    uint32_t run, slept;
+    double ad = 0;
+    uint8_t i;
+
+    set_state(AD_ACTIVE);
+    run = acct.t - acct.run;
+    slept = acct.slept - acct.run_slept;
+    for (i = AD_DOWN; i <= AD_ACTIVE; i++)
+        ad += (double) acct.time[i] * pgm_read_word(&ad_ua[i]) * BOARD_NDEVICES;
+
+    /*  Keep the output of runs without power saving as it was */
+    if (opts.sleep || opts.pwrdown)
+        fprintf_P(stream, PSTR("# power %.1f%% awake, %.2f mA, %.2f mA average\n"),
+            run ? 100.0 * (run - slept) / run : 100.0,
+            current(run, slept, (double) run * POWER_AD5933_ACTIVE_UA * BOARD_NDEVICES),
+            current(acct.t - acct.t0, acct.slept, ad));
+
+    for (i = AD_DOWN; i <= AD_ACTIVE; i++)
+        acct.time[i] = 0;
+    acct.slept = 0;
+    acct.t0 = acct.t;
+
+    if (opts.pwrdown) {
+        for (i = 0; i < BOARD_NDEVICES; i++)
+            ad5933_pwrdown(&ad5933_devices[i]);
+        set_state(AD_DOWN);
+    } else {
+        set_state(AD_STANDBY);
+    }
+}
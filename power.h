@@ -0,0 +1,66 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __POWER_H
+#define __POWER_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "settings.h"
+
+/*  Typical supply currents in uA used for the estimate of power_end_run(),
+ *  ATmega168A at 12 MHz and AD5933 at 5 V. Adjust for the board. */
+#define POWER_MCU_ACTIVE_UA    6000UL
+#define POWER_MCU_IDLE_UA      1500UL
+#define POWER_AD5933_ACTIVE_UA 17000UL
+#define POWER_AD5933_STANDBY_UA 11000UL
+#define POWER_AD5933_DOWN_UA   1UL
+
+/*  Select idle sleep mode and set the options. Assumes the AD5933 front-
+ *  ends have just been put into standby. */
+void power_init(const PowerOptions *o);
+void power_set(const PowerOptions *o);
+
+/*  Sleep in idle mode until the next interrupt, if enabled. The system
+ *  tick wakes the CPU up at least every CLOCK_TICK_US. Returns at once
+ *  if interrupts are disabled. */
+void power_idle(void);
+bool power_can_idle(void);
+
+/*  Bring powered down front-ends into standby. The AD5933 is ready once
+ *  the warm-up time has passed after that, see power_ready(). */
+void power_wake(void);
+bool power_ready(void);
+
+/*  Bracket a run. With sleep or pwrdown set, the end prints "# power
+ *  <awake %> awake, <mA> mA, <mA> mA average" with the share of time the
+ *  MCU was awake during the run, the estimated supply current of the run
+ *  and that since the end of the previous run. It powers the front-ends
+ *  down if enabled. */
+void power_begin_run(void);
+void power_end_run(FILE *stream);
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include "ref.h"
+
+/*  Corrections are complex factors in Q24 */
+#define Q    24
+#define ONE  (1L << Q)
+
+static struct {
+    uint8_t n;
+    uint16_t point[REF_MAX_POINTS];
+    bool base[REF_MAX_POINTS];          // baseline taken
+    int32_t real[REF_MAX_POINTS];       // baseline
+    int32_t imag[REF_MAX_POINTS];
+    int32_t cr[REF_MAX_POINTS];         // correction
+    int32_t ci[REF_MAX_POINTS];
+} ref;
+
+uint8_t ref_init(uint16_t npoints)
+{
+    uint8_t j;
+
+    ref.n = npoints < REF_MAX_POINTS ? npoints : REF_MAX_POINTS;
+    for (j = 0; j < ref.n; j++) {
+        ref.point[j] = ref.n > 1 ? (uint32_t) j * (npoints - 1) / (ref.n - 1) : 0;
+        ref.base[j] = false;
+        ref.cr[j] = ONE;
+        ref.ci[j] = 0;
+    }
+    return ref.n;
+}
+
+uint16_t ref_point(uint8_t j)
+{
+    return ref.point[j];
+}
+
+/*  The correction is baseline / reading, which turns the reading back
+ *  into the baseline and everything measured alongside it likewise */
+void ref_update(uint8_t j, int32_t real, int32_t imag)
+{
+    double m2 = (double) real * real + (double) imag * imag;
+    double cr, ci;
+
+    if (m2 == 0)
+        return;
+    if (!ref.base[j]) {
+        ref.real[j] = real;
+        ref.imag[j] = imag;
+        ref.base[j] = true;
+        return;
+    }
+
+    cr = ((double) ref.real[j] * real + (double) ref.imag[j] * imag) / m2;
+    ci = ((double) ref.imag[j] * real - (double) ref.real[j] * imag) / m2;
+    if (fabs(cr) < 64 && fabs(ci) < 64) {
+        ref.cr[j] = lround(cr * ONE);
+        ref.ci[j] = lround(ci * ONE);
+    }
+}
+
+int32_t ref_gain(uint8_t j, double *phase)
+{
+    double cr = (double) ref.cr[j] / ONE;
+    double ci = (double) ref.ci[j] / ONE;
+
+    *phase = atan2(ci, cr) * (180 / M_PI);
+    return lround((sqrt(cr * cr + ci * ci) - 1) * 1000000);
+}
+
+/*  Linear between the reference points, constant beyond them */
+void ref_correct(uint16_t point, int32_t *real, int32_t *imag)
+{
+    int32_t cr, ci;
+    int64_t r, i;
+    uint8_t j;
+
+    if (ref.n == 0)
+        return;
+    for (j = 0; j + 1 < ref.n && point >= ref.point[j + 1]; j++)
+        ;
+    cr = ref.cr[j];
+    ci = ref.ci[j];
+    if (j + 1 < ref.n && point > ref.point[j]) {
+        cr += (int64_t) (ref.cr[j + 1] - cr) * (point - ref.point[j])
+            / (ref.point[j + 1] - ref.point[j]);
+        ci += (int64_t) (ref.ci[j + 1] - ci) * (point - ref.point[j])
+            / (ref.point[j + 1] - ref.point[j]);
+    }
+
+    r = (int64_t) *real * cr - (int64_t) *imag * ci;
+    i = (int64_t) *real * ci + (int64_t) *imag * cr;
+    *real = (r + (ONE / 2)) >> Q;
+    *imag = (i + (ONE / 2)) >> Q;
+}
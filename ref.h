@@ -0,0 +1,68 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __REF_H
+#define __REF_H
+
+#include <inttypes.h>
+
+/*  Interleaved reference load measurements. During a run PORTB is now and
+ *  then switched to the on-board reference load, see board.h, which is
+ *  measured at a few points of the sweep before every ref:th sweep, or
+ *  every ref seconds of a freerun, printed as "# ref <tick> <ppm> <deg>...".
+ *  Not in scan, zoom, round-robin, interleaved or triggered runs. The first
+ *  reading of each point is its baseline, and every later one updates a
+ *  complex correction that brings the reading back to the baseline. The
+ *  results of all points are corrected with the correction interpolated
+ *  between the reference points around them, so gain and phase drift
+ *  while the run goes on, e.g. with temperature, is cancelled and a
+ *  calibration made at the start of the run stays valid. */
+
+/*  Reference points per sweep and samples averaged for each reading */
+#define REF_MAX_POINTS 3
+#define REF_AVERAGE    16
+
+/*  Spread up to REF_MAX_POINTS reference points evenly over a sweep of
+ *  npoints points, from the first to the last. Returns the number of
+ *  reference points. The correction is neutral until the second reading
+ *  of a point. */
+uint8_t ref_init(uint16_t npoints);
+
+/*  Sweep point measured as reference point j */
+uint16_t ref_point(uint8_t j);
+
+/*  Update reference point j with the sum of REF_AVERAGE samples. A
+ *  reading of zero, e.g. with the switch open, is ignored. */
+void ref_update(uint8_t j, int32_t real, int32_t imag);
+
+/*  Correction of reference point j. Returns its gain in ppm and stores
+ *  its phase in degrees. */
+int32_t ref_gain(uint8_t j, double *phase);
+
+/*  Correct the real and imaginary parts, or sums of them, of a point */
+void ref_correct(uint16_t point, int32_t *real, int32_t *imag);
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "ad5933.h"
+#include "scan.h"
+
+static ScanChannel channels[SCAN_MAX_CHANNELS];
+
+int scan_set(uint8_t ch, uint8_t port, uint8_t settle, uint32_t fcode)
+{
+    if (ch >= SCAN_MAX_CHANNELS)
+        return -1;
+    channels[ch].used = true;
+    channels[ch].port = port;
+    channels[ch].settle = settle;
+    channels[ch].fcode = fcode;
+    return 0;
+}
+
+void scan_clear(void)
+{
+    memset(channels, 0, sizeof(channels));
+}
+
+const ScanChannel *scan_get(uint8_t ch)
+{
+    if (ch >= SCAN_MAX_CHANNELS || !channels[ch].used)
+        return NULL;
+    return &channels[ch];
+}
+
+uint8_t scan_order(uint8_t *order)
+{
+    uint8_t n = 0, i, j;
+
+    /*  Insertion sort by frequency code, which is stable */
+    for (i = 0; i < SCAN_MAX_CHANNELS; i++) {
+        if (!channels[i].used)
+            continue;
+        for (j = n++; j > 0 && channels[order[j - 1]].fcode > channels[i].fcode; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+    return n;
+}
+
+void scan_print(FILE *stream)
+{
+    uint8_t i;
+
+    for (i = 0; i < SCAN_MAX_CHANNELS; i++)
+        if (channels[i].used)
+            fprintf_P(stream, PSTR("%hhu %hhu %hhu %.2f\n"), i, channels[i].port,
+                channels[i].settle, ad5933_freq_hz(channels[i].fcode));
+}
@@ -0,0 +1,68 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*  Electrode multiplexer table. Each channel is a PORTB pattern driving
+ *  the analog switches of one electrode configuration, the time the
+ *  switches need to settle, and what to measure: a sweep with the current
+ *  options or a single frequency. A scan run makes count passes over the
+ *  table in scan_order(), every other one backwards, so the AD5933 is
+ *  reprogrammed as seldom as possible. Results are prefixed with the
+ *  channel, passes with "# <pass> <tick>" unless count is 1. */
+#define SCAN_MAX_CHANNELS 8
+
+typedef struct {
+    bool used;
+    uint8_t port;
+    uint8_t settle;     // ms
+    uint32_t fcode;     // see ad5933_freq_code(), 0 = sweep
+} ScanChannel;
+
+/*  Set channel ch. Returns -1 if ch is out of range. */
+int scan_set(uint8_t ch, uint8_t port, uint8_t settle, uint32_t fcode);
+
+/*  Remove all channels */
+void scan_clear(void);
+
+/*  Channel ch, or NULL if it is not used */
+const ScanChannel *scan_get(uint8_t ch);
+
+/*  Store the used channels into order so that channels measured the same
+ *  way are adjacent: sweeps first, then single frequencies in ascending
+ *  order. Within a group the channel order is kept. Returns the number of
+ *  channels. */
+uint8_t scan_order(uint8_t *order);
+
+/*  Print the table as "<ch> <port> <settle> <f>" lines, f = 0 for sweeps */
+void scan_print(FILE *stream);
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <inttypes.h>
+#include <string.h>
+#include "settings.h"
+
+/*  Every EEPROM record is laid out as version byte, payload and CRC16 of
+ *  the preceding bytes. */
+typedef struct {
+    uint8_t version;
+    Settings settings;
+    uint16_t crc;
+} settings_record_t;
+
+typedef struct {
+    uint8_t version;
+    Profile profile;
+    uint16_t crc;
+} profile_record_t;
+
+/*  One object, so that the linker cannot reorder the records. Profiles
+ *  come first, so that Settings can grow without moving them. */
+static struct {
+    profile_record_t profiles[SETTINGS_NPROFILES];
+    settings_record_t settings;
+} EEMEM ee;
+
+static int record_load(void *dst, void *ee, uint8_t n, uint8_t version)
+{
+    uint8_t *p = ee;
+    uint16_t crc = 0xffff;
+    uint8_t m;
+
+    if (eeprom_read_byte(p) != version)
+        return -1;
+    for (m = 0; m <= n; m++)
+        crc = _crc16_update(crc, eeprom_read_byte(p + m));
+    if (eeprom_read_word((uint16_t *) (p + 1 + n)) != crc)
+        return -1;
+
+    eeprom_read_block(dst, p + 1, n);
+    return 0;
+}
+
+static void record_save(const void *src, void *ee, uint8_t n, uint8_t version)
+{
+    const uint8_t *s = src;
+    uint8_t *p = ee;
+    uint16_t crc = _crc16_update(0xffff, version);
+    uint8_t m;
+
+    for (m = 0; m < n; m++)
+        crc = _crc16_update(crc, s[m]);
+
+    eeprom_update_byte(p, version);
+    eeprom_update_block(src, p + 1, n);
+    eeprom_update_word((uint16_t *) (p + 1 + n), crc);
+}
+
+int settings_load(Settings *s)
+{
+    return record_load(s, &ee.settings, sizeof(*s), SETTINGS_VERSION);
+}
+
+void settings_save(const Settings *s)
+{
+    record_save(s, &ee.settings, sizeof(*s), SETTINGS_VERSION);
+}
+
+int settings_load_profile(uint8_t n, Profile *p)
+{
+    if (n >= SETTINGS_NPROFILES)
+        return -1;
+    return record_load(p, &ee.profiles[n], sizeof(*p), PROFILE_VERSION);
+}
+
+int settings_save_profile(uint8_t n, const Profile *p)
+{
+    if (n >= SETTINGS_NPROFILES)
+        return -1;
+    record_save(p, &ee.profiles[n], sizeof(*p), PROFILE_VERSION);
+    return 0;
+}
+
+int settings_find_profile(const char *name, Profile *p)
+{
+    uint8_t n;
+
+    for (n = 0; n < SETTINGS_NPROFILES; n++)
+        if (settings_load_profile(n, p) == 0
+                && strncmp(p->name, name, PROFILE_NAME_LEN) == 0)
+            return n;
+    return -1;
+}
@@ -0,0 +1,111 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012-2013 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __SETTINGS_H
+#define __SETTINGS_H
+
+#include <inttypes.h>
+
+/*  Bump whenever the layout of Settings changes. A stored record with a
+ *  different version is ignored and the compiled-in defaults are used. */
+#define SETTINGS_VERSION 3
+
+/*  Boot modes. Anything but BOOT_NORMAL skips the power-up delay and the
+ *  banner; BOOT_SWEEP and BOOT_FREERUN also start measuring right away. */
+#define BOOT_NORMAL  0
+#define BOOT_QUIET   1
+#define BOOT_SWEEP   2
+#define BOOT_FREERUN 3
+
+typedef struct SweepOptions SweepOptions;
+
+struct SweepOptions {
+    double fstart;
+    double fincr;
+    uint16_t nincr;
+    uint16_t tsettle;
+    uint8_t xtsettle;
+    uint8_t nrange;
+    uint8_t pgagain;
+    uint8_t average;
+};
+
+/*  Named profiles stored in EEPROM, see settings_load_profile() */
+#define SETTINGS_NPROFILES 4
+#define PROFILE_NAME_LEN   8 // including the terminating null
+
+/*  Bump whenever the layout of Profile changes, as for SETTINGS_VERSION */
+#define PROFILE_VERSION 1
+
+typedef struct Profile Profile;
+
+struct Profile {
+    char name[PROFILE_NAME_LEN];
+    SweepOptions opts;
+};
+
+/*  Power saving, see power.h */
+typedef struct PowerOptions PowerOptions;
+
+struct PowerOptions {
+    uint8_t sleep;      // idle the MCU while waiting for interrupts
+    uint8_t pwrdown;    // power the AD5933 down between runs
+    uint16_t warmup;    // ms from power-down to the next run
+};
+
+/*  Serial link, see usart0.h */
+typedef struct LinkOptions LinkOptions;
+
+struct LinkOptions {
+    uint8_t flow;       // USART0_FLOW_NONE, _XONXOFF or _RTSCTS
+    uint8_t drop;       // drop freerun samples instead of waiting for the host
+};
+
+typedef struct Settings Settings;
+
+struct Settings {
+    SweepOptions opts;
+    uint8_t boot;
+    PowerOptions power;
+    LinkOptions link;
+};
+
+/*  Load settings from EEPROM. Returns -1 and leaves s untouched if the
+ *  stored record is missing, corrupted or of another version. */
+int settings_load(Settings *s);
+
+/*  Store settings into EEPROM. Only the changed bytes are written. */
+void settings_save(const Settings *s);
+
+/*  Load and store profile in slot n. Loader returns -1 if the slot is out of
+ *  range or empty, saver returns -1 if the slot is out of range. */
+int settings_load_profile(uint8_t n, Profile *p);
+int settings_save_profile(uint8_t n, const Profile *p);
+
+/*  Look up a profile by name. Returns its slot or -1 if not found. */
+int settings_find_profile(const char *name, Profile *p);
+
+#endif
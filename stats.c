@@ -0,0 +1,123 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+#include "workspace.h"
+
+#define MEAN_SHIFT 16
+#define M2_SHIFT   4
+
+#define points (workspace.stats)
+
+/*  t(0.975, df) * 1000 for df = 1...29 */
+static const uint16_t student_t[] PROGMEM = {
+    12706, 4303, 3182, 2776, 2571, 2447, 2365, 2306, 2262, 2228,
+    2201, 2179, 2160, 2145, 2131, 2120, 2110, 2101, 2093, 2086,
+    2080, 2074, 2069, 2064, 2060, 2056, 2052, 2048, 2045
+};
+
+/*  Quotient rounded to the nearest integer. Truncation would bias the
+ *  running mean by up to one unit per sample. */
+static int64_t divide(int64_t a, uint16_t b)
+{
+    a = a >= 0 ? a + b / 2 : a - b / 2;
+    /*  Deviations of less than 2^15 output units need no 64-bit division */
+    if (a >= INT32_MIN && a <= INT32_MAX)
+        return (int32_t) a / b;
+    return a / b;
+}
+
+/*  Deviation in 1/256 of the output unit, rounded */
+static int32_t coarse(int64_t d)
+{
+    return (d + (1 << (MEAN_SHIFT - 9))) >> (MEAN_SHIFT - 8);
+}
+
+/*  x is in 1/256 of the output unit */
+static void update(int32_t *mean, uint32_t *m2, int32_t x, uint16_t k)
+{
+    int64_t xm = (int64_t) x * (1 << (MEAN_SHIFT - 8));
+    int64_t d = xm - *mean;
+    int64_t v;
+
+    *mean += divide(d, k);
+    /*  d * (x - mean) is in 1/2^16 and never negative, m2 in 1/2^4 */
+    v = ((int64_t) coarse(d) * coarse(xm - *mean) + (1L << (16 - M2_SHIFT - 1)))
+        >> (16 - M2_SHIFT);
+    v += *m2;
+    *m2 = v > UINT32_MAX ? UINT32_MAX : v;
+}
+
+void stats_reset(void)
+{
+    memset(points, 0, sizeof(points));
+}
+
+void stats_put(uint16_t point, uint16_t k, int32_t real, int32_t imag)
+{
+    StatsPoint *p = &points[point % STATS_MAX_POINTS];
+
+    if (k == 0)
+        return;
+    update(&p->mean[0], &p->m2[0], real, k);
+    update(&p->mean[1], &p->m2[1], imag, k);
+}
+
+/*  t(0.975, k - 1) standard errors of the mean, from the sample variance */
+static double ci95(uint32_t m2, uint16_t k)
+{
+    double t;
+
+    if (k < 2)
+        return 0;
+    if (k - 1 <= sizeof(student_t) / sizeof(student_t[0]))
+        t = pgm_read_word(&student_t[k - 2]) / 1000.0;
+    else
+        t = 1.96 + 2.4 / (k - 1);
+    return t * sqrt((double) m2 / (1 << M2_SHIFT) / (k - 1) / k);
+}
+
+void stats_print(FILE *stream, uint16_t npoints, uint16_t sweeps, uint16_t done)
+{
+    StatsPoint *p;
+    uint16_t n, k;
+
+    fprintf_P(stream, PSTR("# stats %u sweeps\n"), sweeps);
+    for (n = 0; n < npoints && n < STATS_MAX_POINTS; n++) {
+        p = &points[n];
+        k = (n < done) ? sweeps : sweeps - 1;
+        if (k == 0)
+            break;
+        fprintf_P(stream, PSTR("%.4f %.4f %.4f %.4f\n"),
+            (double) p->mean[0] / (1L << MEAN_SHIFT), (double) p->mean[1] / (1L << MEAN_SHIFT),
+            ci95(p->m2[0], k), ci95(p->m2[1], k));
+    }
+}
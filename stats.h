@@ -0,0 +1,65 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/*  Per-point statistics over the sweeps of a run. Every point keeps a
+ *  running mean and sum of squared deviations (Welford) of the real and
+ *  imaginary parts, so the result costs no more link time than a single
+ *  sweep however many sweeps are run. At 16 bytes a point the limit keeps
+ *  the table within the 384 bytes the delta and zoom stages already take
+ *  from the workspace, so a stats run takes nincr of at most 23. Nothing
+ *  is printed per sweep, stats_print() runs when the run ends or is
+ *  aborted, at the latest after STATS_MAX_SWEEPS. */
+#define STATS_MAX_POINTS 24
+#define STATS_MAX_SWEEPS UINT16_MAX
+
+/*  Mean in 1/65536 of the output unit, so that its rounding stays well
+ *  inside the confidence interval even after STATS_MAX_SWEEPS sweeps, and
+ *  the sum of squared deviations in 1/16 of the squared output unit. The
+ *  sum saturates once sweeps * variance reaches 2^28, a standard deviation
+ *  of 64 over STATS_MAX_SWEEPS sweeps. */
+typedef struct {
+    int32_t mean[2];
+    uint32_t m2[2];
+} StatsPoint;
+
+void stats_reset(void);
+
+/*  Add the k:th sample (k >= 1) of a point, given in 1/256 */
+void stats_put(uint16_t point, uint16_t k, int32_t real, int32_t imag);
+
+/*  Print a "# stats <sweeps> sweeps" header and the mean of the real and
+ *  imaginary part of each point with the half width of their 95 %
+ *  confidence intervals, from Student's t for up to 30 sweeps and
+ *  t ~ 1.96 + 2.4 / df beyond. Points from done on have one sample less. */
+void stats_print(FILE *stream, uint16_t npoints, uint16_t sweeps, uint16_t done);
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <inttypes.h>
+#include "temp.h"
+
+static struct {
+    int16_t ppm;
+    int16_t ref;
+    int32_t corr;       // ppm
+} drift;
+
+int16_t temp_centi(uint16_t code)
+{
+    int16_t t = code & 0x3fff;
+
+    if (t & 0x2000)
+        t -= 0x4000;
+    return ((int32_t) t * 100 + (t >= 0 ? 16 : -16)) / 32;
+}
+
+void temp_drift_init(int16_t ppm, int16_t ref)
+{
+    drift.ppm = ppm;
+    drift.ref = ref;
+    drift.corr = 0;
+}
+
+/*  The gain has grown by ppm * (t - ref), so results are scaled back by
+ *  the same amount. First order is plenty for the few hundred ppm seen. */
+int32_t temp_drift_update(int16_t t)
+{
+    if (drift.ref == TEMP_REF_FIRST)
+        drift.ref = t;
+    drift.corr = -(int32_t) drift.ppm * (t - drift.ref) / 100;
+    return drift.corr;
+}
+
+int32_t temp_correct(int32_t v)
+{
+    return v + (int64_t) v * drift.corr / 1000000;
+}
@@ -0,0 +1,57 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __TEMP_H
+#define __TEMP_H
+
+#include <inttypes.h>
+
+/*  AD5933 on-chip temperature. Readings are taken before every temp:th
+ *  sweep, or every temp seconds of a freerun, and printed as
+ *  "# temp <tick> <C> [<ppm>]", except in interleaved or triggered runs.
+ *  They may be used to correct the temperature drift of the front-end
+ *  gain. */
+
+/*  Reference temperature is taken from the first reading of the run */
+#define TEMP_REF_FIRST INT16_MIN
+
+/*  Temperature in 1/100 C from the 14-bit two's complement code of the
+ *  temperature registers, which count 1/32 C */
+int16_t temp_centi(uint16_t code);
+
+/*  Set up the drift correction for a gain drift of ppm per C around the
+ *  reference temperature ref in 1/100 C. The correction is neutral until
+ *  the first temp_drift_update(). */
+void temp_drift_init(int16_t ppm, int16_t ref);
+
+/*  Update the correction for the temperature t in 1/100 C. Returns the
+ *  correction applied from now on in ppm. */
+int32_t temp_drift_update(int16_t t);
+
+/*  Correct a real or imaginary part, or a sum of them */
+int32_t temp_correct(int32_t v);
+
+#endif
@@ -31,12 +31,112 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include <inttypes.h>
 #include <util/twi.h>
+#include "power.h"
 #include "twi.h"
 
 uint8_t twi_status;
 
+#ifdef TWI_TRACE
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "clock.h"
+
+#if TWI_TRACE > 128 || (TWI_TRACE & (TWI_TRACE - 1))
+    #error "TWI_TRACE must be a power of two up to 128"
+#endif
+
+typedef struct {
+    uint16_t dt;
+    char op;
+    uint8_t data;
+    uint8_t status;
+} TwiEvent;
+
+static struct {
+    TwiEvent ev[TWI_TRACE];
+    uint8_t head;
+    uint8_t n;
+    uint16_t lost;
+    uint32_t last;
+} trace;
+
+/*  Also called from the INT0 ISR of acquire.c, hence atomic */
+static void trace_event(char op, uint8_t data, uint8_t status)
+{
+    TwiEvent *e;
+    uint32_t now, dt;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        e = &trace.ev[trace.head];
+        now = clock_fine();
+        dt = now - trace.last;
+        trace.last = now;
+        e->dt = (dt > UINT16_MAX) ? UINT16_MAX : dt;
+        e->op = op;
+        e->data = data;
+        e->status = status;
+        trace.head = (trace.head + 1) & (TWI_TRACE - 1);
+        if (trace.n < TWI_TRACE)
+            trace.n++;
+        else if (trace.lost < UINT16_MAX)
+            trace.lost++;
+    }
+}
+
+void twi_trace_dump(FILE *stream)
+{
+    TwiEvent e;
+    uint16_t lost;
+    uint8_t n;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        n = trace.n;
+        lost = trace.lost;
+        trace.lost = 0;
+    }
+    fprintf_P(stream, PSTR("# twi %hhu events, %u lost, %lu Hz\n"), n, lost, CLOCK_FINE_HZ);
+    /*  One event at a time, the ISR may add more while printing */
+    for (;;) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            n = trace.n;
+            if (n > 0) {
+                e = trace.ev[(trace.head - n) & (TWI_TRACE - 1)];
+                trace.n--;
+            }
+        }
+        if (n == 0)
+            break;
+        fprintf_P(stream, PSTR("%u %c %02x %02x\n"), e.dt, e.op, e.data, e.status);
+    }
+}
+
+#define TRACE(op, data, status) trace_event(op, data, status)
+#else
+#define TRACE(op, data, status)
+#endif
+
+/*  Only wakes the CPU up. TWINT is left set, writing it as zero has no
+ *  effect, so the next operation is not started from here. */
+ISR(TWI_vect)
+{
+    TWCR &= ~(_BV(TWIE) | _BV(TWINT));
+}
+
+void twi_wait(void)
+{
+    if (!power_can_idle()) {
+        while ((TWCR & _BV(TWINT)) == 0);
+        return;
+    }
+    TWCR = (TWCR & ~_BV(TWINT)) | _BV(TWIE);
+    while ((TWCR & _BV(TWINT)) == 0)
+        power_idle();
+}
+
 int twi_sstart(void)
 {
 begin:
@@ -44,7 +144,10 @@ begin:
     TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN); /* send start condition */
     TWI_WAIT_FOR_TX(); /* wait for transmission */
 
-    switch (twi_status = TW_STATUS) {
+    twi_status = TW_STATUS;
+    TRACE('S', 0, twi_status);
+
+    switch (twi_status) {
         case TW_REP_START:
         case TW_START:
             break;
@@ -81,7 +184,10 @@ begin:
     TWCR = _BV(TWINT) | _BV(TWEN); /* clear interrupt to start transmission */
     TWI_WAIT_FOR_TX();
 
-    switch (twi_status = TW_STATUS) {
+    twi_status = TW_STATUS;
+    TRACE('A', addr | rwbit, twi_status);
+
+    switch (twi_status) {
         case TW_MT_SLA_ACK:
             if (rwbit != TW_WRITE)
                 goto error;
@@ -123,7 +229,10 @@ int twi_write(uint8_t *buf, int n)
         TWCR = _BV(TWINT) | _BV(TWEN);
         TWI_WAIT_FOR_TX();
 
-        switch (twi_status = TW_STATUS) {
+        twi_status = TW_STATUS;
+        TRACE('W', buf[rv], twi_status);
+
+        switch (twi_status) {
             case TW_MT_DATA_ACK:
                 rv++; /* byte transmission ok */
                 break;
@@ -161,7 +270,10 @@ int twi_read(uint8_t *buf, int n)
             TWCR = _BV(TWINT) | _BV(TWEN);
         TWI_WAIT_FOR_TX();
 
-        switch ((twi_status = TW_STATUS)) {
+        twi_status = TW_STATUS;
+        TRACE('R', TWDR, twi_status);
+
+        switch (twi_status) {
             case TW_MR_DATA_NACK:
                 n = 0; /* last byte transmitted, fall through */
             case TW_MR_DATA_ACK:
@@ -180,6 +292,7 @@ int twi_read(uint8_t *buf, int n)
 void twi_stop(void)
 {
     TWCR = _BV(TWINT) | _BV(TWSTO) | _BV(TWEN);
+    TRACE('P', 0, TW_NO_INFO);
 }
 
 void twi_rstart(void)
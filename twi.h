@@ -28,7 +28,16 @@
 #define __TWI_FUNCS_H 1
 
 #define TWI_MAX_ITER 100
-#define TWI_WAIT_FOR_TX() do {} while ((TWCR & _BV(TWINT)) == 0)
+#define TWI_WAIT_FOR_TX() twi_wait()
+
+/**
+ * Wait for the current bus operation to finish
+ *
+ * Sleeps in idle mode until the TWI interrupt if power_can_idle(), see
+ * power.h, and spins otherwise, as it does inside an ISR. The trigger ISR
+ * of acquire.c starts a sweep this way.
+ */
+void twi_wait(void);
 
 /**
  * Send start condition
@@ -78,5 +87,30 @@ void twi_stop(void);
  */
 void twi_rstart(void);
 
+#ifdef TWI_TRACE
+#include <stdio.h>
+
+/**
+ * Bus trace
+ *
+ * Building with -DTWI_TRACE=<n> records the last n bus events (n a power of
+ * two, at most 128) in a ring buffer of 5 bytes per event. Every start,
+ * address, data byte and stop is stored with the TW_STATUS it ended in and
+ * the clock_fine() counts since the previous event, saturated at 65535.
+ *
+ * twi_trace_dump() prints and empties the buffer as
+ *
+ *     # twi <events> events, <lost> lost, <clock_fine Hz> Hz
+ *     <dt> <op> <data> <status>
+ *
+ * where op is S (start), A (SLA+R/W in data), W (byte written), R (byte
+ * read) or P (stop), data and status are in hex and lost counts the events
+ * overwritten since the last dump. Events are recorded atomically, since
+ * the trigger ISR uses the bus too. host/ebi-twi replays a dump on the
+ * simulated bus.
+ */
+void twi_trace_dump(FILE *stream);
+#endif
+
 #endif
 
@@ -25,17 +25,154 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include "power.h"
 #include "usart0.h"
 
+#define RX_MASK (USART0_RX_BUFSIZE - 1)
+#define TX_MASK (USART0_TX_BUFSIZE - 1)
+
+#define ESC  27
+#define XON  0x11
+#define XOFF 0x13
+
+/*  Hardware handshake pins, both active low */
+#define FLOW_DDR  DDRD
+#define FLOW_PORT PORTD
+#define FLOW_PIN  PIND
+#define CTS       PD4 // PCINT20
+#define RTS       PD5
+
+/*  RTS is deasserted above and asserted again below these fill levels */
+#define RX_HIGH (USART0_RX_BUFSIZE * 3 / 4)
+#define RX_LOW  (USART0_RX_BUFSIZE / 4)
+
+static volatile uint8_t rx_buf[USART0_RX_BUFSIZE];
+static volatile uint8_t rx_head, rx_tail;
+static volatile uint8_t tx_buf[USART0_TX_BUFSIZE];
+static volatile uint8_t tx_head, tx_tail;
+static volatile bool rx_escape;
+static volatile bool tx_xoff;   // XOFF received, waiting for XON
+static uint8_t flow;
+
+/*  The host does not want more characters right now */
+static bool tx_held(void)
+{
+    if (flow == USART0_FLOW_XONXOFF)
+        return tx_xoff;
+    if (flow == USART0_FLOW_RTSCTS)
+        return bit_is_set(FLOW_PIN, CTS);
+    return false;
+}
+
+ISR(USART_RX_vect)
+{
+    uint8_t c = UDR0;
+    uint8_t next = (rx_head + 1) & RX_MASK;
+
+    if (c == ESC) {
+        rx_escape = true;
+        return;
+    }
+    if (flow == USART0_FLOW_XONXOFF && (c == XON || c == XOFF)) {
+        tx_xoff = (c == XOFF);
+        if (!tx_xoff && tx_head != tx_tail)
+            UCSR0B |= _BV(UDRIE0);
+        return;
+    }
+    if (next != rx_tail) { // drop the character if the buffer is full
+        rx_buf[rx_head] = c;
+        rx_head = next;
+    }
+    if (flow == USART0_FLOW_RTSCTS && ((rx_head - rx_tail) & RX_MASK) >= RX_HIGH)
+        FLOW_PORT |= _BV(RTS);
+}
+
+ISR(USART_UDRE_vect)
+{
+    /*  Stopped until XON or a falling edge of CTS enables it again */
+    if (tx_head == tx_tail || tx_held()) {
+        UCSR0B &= ~_BV(UDRIE0);
+        return;
+    }
+    UDR0 = tx_buf[tx_tail];
+    tx_tail = (tx_tail + 1) & TX_MASK;
+}
+
+ISR(PCINT2_vect)
+{
+    if (tx_head != tx_tail && !tx_held())
+        UCSR0B |= _BV(UDRIE0);
+}
+
 int usart0_putchar(char c, FILE *stream) {
-    while(!(UCSR0A & (1 << UDRE0)));
-    UDR0 = c;
+    uint8_t next = (tx_head + 1) & TX_MASK;
+
+    while (next == tx_tail) {
+        if (rx_escape)
+            return 0; // the host is not reading, let the abort through
+        power_idle(); // woken by the transmit interrupt
+    }
+    tx_buf[tx_head] = c;
+    tx_head = next;
+    UCSR0B |= _BV(UDRIE0);
     return 0;
 }
 
 int usart0_getchar(FILE *stream) {
-    while(!USART0_DATARECEIVED);
-    return UDR0;
+    uint8_t c;
+
+    while (!USART0_DATARECEIVED)
+        power_idle();
+    c = rx_buf[rx_tail];
+    rx_tail = (rx_tail + 1) & RX_MASK;
+    if (flow == USART0_FLOW_RTSCTS && usart0_rx_available() <= RX_LOW)
+        FLOW_PORT &= ~_BV(RTS);
+    return c;
+}
+
+uint8_t usart0_rx_available(void)
+{
+    return (rx_head - rx_tail) & RX_MASK;
 }
 
+bool usart0_escape(void)
+{
+    bool esc;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        esc = rx_escape;
+        rx_escape = false;
+    }
+    return esc;
+}
+
+void usart0_set_flow(uint8_t mode)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        flow = mode;
+        tx_xoff = false;
+        if (mode == USART0_FLOW_RTSCTS) {
+            FLOW_DDR &= ~_BV(CTS);
+            FLOW_PORT |= _BV(CTS);
+            FLOW_DDR |= _BV(RTS);
+            FLOW_PORT &= ~_BV(RTS);
+            PCMSK2 |= _BV(PCINT20);
+            PCICR |= _BV(PCIE2);
+        } else {
+            PCMSK2 &= ~_BV(PCINT20);
+            PCICR &= ~_BV(PCIE2);
+        }
+        if (tx_head != tx_tail)
+            UCSR0B |= _BV(UDRIE0);
+    }
+}
+
+uint8_t usart0_tx_free(void)
+{
+    return (tx_tail - tx_head - 1) & TX_MASK;
+}
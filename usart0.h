@@ -27,14 +27,55 @@
 #ifndef __USART0_H
 #define __USART0_H
 
-#define USART0_DATARECEIVED (UCSR0A & (1 << RXC0))
-#define USART0_ESCAPE (USART0_DATARECEIVED && (getchar() == 27))
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
 
-/*  Send character */
+/*  Interrupt driven ring buffers, sizes must be powers of two */
+#define USART0_RX_BUFSIZE 32
+#define USART0_TX_BUFSIZE 64
+
+#define USART0_DATARECEIVED (usart0_rx_available() != 0)
+#define USART0_ESCAPE (usart0_escape())
+
+/*  Flow control modes of usart0_set_flow().
+ *
+ *  USART0_FLOW_XONXOFF: XOFF (DC3) received from the host stops sending
+ *  and XON (DC1) resumes it. Both are consumed by the receive interrupt.
+ *  The board never sends them, as delta frames are binary, so the host
+ *  should enable IXOFF but not IXON.
+ *
+ *  USART0_FLOW_RTSCTS: sending stops while CTS (PD4, pulled up) is high
+ *  and resumes on its falling edge. RTS (PD5) is driven high while the
+ *  receive buffer is three quarters full and low again once it has been
+ *  read down to a quarter. Both are active low. */
+#define USART0_FLOW_NONE    0
+#define USART0_FLOW_XONXOFF 1
+#define USART0_FLOW_RTSCTS  2
+
+/*  Send character. Blocks while the transmit buffer is full, which with
+ *  flow control lasts as long as the host holds the board off. An ESC
+ *  received meanwhile makes it discard the character instead, so that a
+ *  stalled host can still abort the running command. */
 int usart0_putchar(char c, FILE *stream);
 
-/*  Receive character */
+/*  Receive character. Blocks until one is available. */
 int usart0_getchar(FILE *stream);
 
+/*  Number of received characters waiting in the buffer */
+uint8_t usart0_rx_available(void);
+
+/*  ESC never enters the receive buffer. Returns true once for every ESC
+ *  received since the previous call. */
+bool usart0_escape(void);
+
+/*  Select the flow control mode. Sending is resumed and RTS asserted. */
+void usart0_set_flow(uint8_t mode);
+
+/*  Number of characters that fit into the transmit buffer without
+ *  blocking, for producers that rather drop data than wait. A freerun
+ *  with drop set prints "# lost <n>" before the next sample it sends. */
+uint8_t usart0_tx_free(void);
+
 #endif
 
@@ -0,0 +1,51 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#ifndef __WORKSPACE_H
+#define __WORKSPACE_H
+
+#include "filter.h"
+#include "event.h"
+#include "delta.h"
+#include "stats.h"
+#include "zoom.h"
+
+/*  Per-run state of the acquisition stages. The stages are never used by
+ *  the same run, so they share the same SRAM. Whoever starts a run resets
+ *  the stages it uses, their state is undefined otherwise. */
+typedef union {
+    struct {
+        FilterChannel filter[FILTER_MAX_CHANNELS];
+        EventChannel event[EVENT_MAX_CHANNELS];
+    } freerun;
+    int16_t delta[DELTA_MAX_POINTS][2];
+    StatsPoint stats[STATS_MAX_POINTS];
+    ZoomPoints zoom;
+} Workspace;
+
+extern Workspace workspace;
+
+#endif
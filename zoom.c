@@ -0,0 +1,157 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#include <avr/pgmspace.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ad5933.h"
+#include "zoom.h"
+#include "workspace.h"
+
+#define points (workspace.zoom)
+
+static void print_point(FILE *stream, uint32_t code, int16_t *p)
+{
+    fprintf_P(stream, PSTR("%.2f %d %d\n"), ad5933_freq_hz(code), p[0], p[1]);
+}
+
+void zoom_put_coarse(uint16_t point, int16_t real, int16_t imag)
+{
+    int16_t *p = points.coarse[point % ZOOM_MAX_POINTS];
+
+    p[0] = real;
+    p[1] = imag;
+}
+
+void zoom_put_dense(FILE *stream, uint16_t point, uint32_t code,
+    int16_t real, int16_t imag)
+{
+    int16_t *p = points.dense[point % ZOOM_MAX_DENSE];
+
+    p[0] = real;
+    p[1] = imag;
+    print_point(stream, code, p);
+}
+
+/*  How strongly point i of a sweep from code f0 in steps of df shows the
+ *  feature. The phase slope is taken against log frequency, which peaks at
+ *  the characteristic frequency of a relaxation, as a central difference,
+ *  one-sided at the ends. */
+static double metric(int16_t (*p)[2], uint16_t n, uint16_t i, uint8_t feature,
+    uint32_t f0, uint32_t df)
+{
+    uint16_t a, b;
+    double d;
+
+    if (feature == ZOOM_REACTANCE)
+        return abs(p[i][1]);
+
+    a = i > 0 ? i - 1 : i;
+    b = i + 1 < n ? i + 1 : i;
+    if (a == b || df == 0)
+        return 0;
+    d = atan2(p[b][1], p[b][0]) - atan2(p[a][1], p[a][0]);
+    if (d > M_PI)
+        d -= 2 * M_PI;
+    else if (d < -M_PI)
+        d += 2 * M_PI;
+    return fabs(d) / (b - a) * ((double) f0 / df + i);
+}
+
+uint8_t zoom_find(uint8_t feature, uint16_t npoints, uint32_t fstart, uint32_t fincr,
+    uint8_t n, uint16_t *center)
+{
+    uint16_t i, best, tmp;
+    uint8_t k, j;
+    double m, max;
+
+    if (npoints > ZOOM_MAX_POINTS)
+        npoints = ZOOM_MAX_POINTS;
+    for (k = 0; k < n; k++) {
+        max = 0;
+        best = npoints;
+        for (i = 0; i < npoints; i++) {
+            for (j = 0; j < k; j++)
+                if (abs((int) i - (int) center[j]) < 3)
+                    break;
+            if (j < k)
+                continue;
+            m = metric(points.coarse, npoints, i, feature, fstart, fincr);
+            if (m > max) {
+                max = m;
+                best = i;
+            }
+        }
+        if (best == npoints)
+            break;
+
+        /*  Keep the centers sorted */
+        for (j = k; j > 0 && center[j - 1] > best; j--) {
+            tmp = center[j - 1];
+            center[j - 1] = best;
+            center[j] = tmp;
+        }
+        center[j] = best;
+    }
+    return k;
+}
+
+double zoom_refine(uint8_t feature, uint16_t npoints, uint32_t start, uint32_t incr)
+{
+    uint16_t i, best = 0;
+    double m, max = -1, y0, y1, y2, den;
+
+    if (npoints > ZOOM_MAX_DENSE)
+        npoints = ZOOM_MAX_DENSE;
+    for (i = 0; i < npoints; i++) {
+        m = metric(points.dense, npoints, i, feature, start, incr);
+        if (m > max) {
+            max = m;
+            best = i;
+        }
+    }
+    if (best == 0 || best + 1 >= npoints)
+        return best;
+
+    /*  Vertex of the parabola through the peak and its neighbours */
+    y0 = metric(points.dense, npoints, best - 1, feature, start, incr);
+    y1 = max;
+    y2 = metric(points.dense, npoints, best + 1, feature, start, incr);
+    den = y0 - 2 * y1 + y2;
+    if (den >= 0)
+        return best;
+    return best + (y0 - y2) / den / 2;
+}
+
+void zoom_print(FILE *stream, uint16_t first, uint16_t last, uint32_t fstart,
+    uint32_t fincr)
+{
+    for (; first < last && first < ZOOM_MAX_POINTS; first++)
+        print_point(stream, fstart + first * fincr, points.coarse[first]);
+}
@@ -0,0 +1,74 @@
+/**
+ * OpenEBI
+ *
+ * Copyright (c) 2012 Kim H Blomqvist
+ * Developed at the Department of Electronics at Aalto University
+ * All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */ 
+#ifndef __ZOOM_H
+#define __ZOOM_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/*  Adaptive zoom sweep. A coarse pass over the programmed sweep is kept
+ *  in SRAM and searched for features, then each feature is swept densely
+ *  from the coarse point below it to the one above it. The result is
+ *  printed as one spectrum ordered by frequency, coarse points replaced
+ *  by the dense ones where they overlap, followed by "# fc <f>" per
+ *  feature. The sweep registers are restored at the end of the run. */
+#define ZOOM_MAX_POINTS  64     // coarse pass
+#define ZOOM_MAX_DENSE   32     // dense sub-sweep
+#define ZOOM_MAX_REGIONS 2
+
+/*  Features to zoom into */
+#define ZOOM_REACTANCE   0      // largest magnitude of the imaginary part
+#define ZOOM_PHASE       1      // fastest change of phase
+
+typedef struct {
+    int16_t coarse[ZOOM_MAX_POINTS][2];
+    int16_t dense[ZOOM_MAX_DENSE][2];
+} ZoomPoints;
+
+void zoom_put_coarse(uint16_t point, int16_t real, int16_t imag);
+
+/*  Store and print a point of a dense sub-sweep measured at code */
+void zoom_put_dense(FILE *stream, uint16_t point, uint32_t code,
+    int16_t real, int16_t imag);
+
+/*  Find up to n features of the given kind in the coarse pass, at least
+ *  three points apart. Their points are stored into center in ascending
+ *  order and their number is returned. fstart and fincr are the frequency
+ *  codes of the pass. */
+uint8_t zoom_find(uint8_t feature, uint16_t npoints, uint32_t fstart, uint32_t fincr,
+    uint8_t n, uint16_t *center);
+
+/*  Position of the feature in the dense sub-sweep from start in steps of
+ *  incr, in points, interpolated between points */
+double zoom_refine(uint8_t feature, uint16_t npoints, uint32_t start, uint32_t incr);
+
+/*  Print coarse points first..last - 1 as "<f> R I" */
+void zoom_print(FILE *stream, uint16_t first, uint16_t last, uint32_t fstart,
+    uint32_t fincr);
+
+#endif